@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#include "metro.cpp"
+
+#ifdef WIN32
+#include <malloc.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/**
+ * Routing benchmark: every ordered pair of stations is queried under every
+ * criterion, in each of these modes:
+ *   search:    One query at a time by searching.
+ *   table:     One at a time from the precomputed route tables.
+ *   landmark:  One at a time by the landmark search, time and distance
+ *              only, on a Metro with landmarks and nothing else.
+ *   hierarchy: One at a time by the contraction hierarchy, time and
+ *              distance only, on a Metro with the hierarchy only.
+ *   batch:     Through query_batch by searching on every worker thread,
+ *              BENCH_BATCH pairs at a time; the latencies are per query
+ *              averaged over each batch.
+ * Usage: bench [-r repeat] [-o output] [-m manifest] [-p pairs] [-k modes]
+ *   -r: Number of passes over all pairs, 1 by default.
+ *   -o: Append one JSON object per run to this file, so that runs can be
+ *       compared over time.
+ *   -m: Load the lines of this manifest, such as one written by
+ *       metro_generate, instead of the shipped network.
+ *   -p: Query this many random pairs per pass instead of all of them, for
+ *       networks too large for all pairs. The route tables are skipped,
+ *       whatever the pairs, when they would take more than
+ *       ROUTE_TABLE_BUDGET bytes.
+ *   -k: Run only these modes, separated by commas, such as
+ *       "search,hierarchy"; all of them by default.
+ * */
+
+#define BENCH_BATCH (4096)
+/**
+ * Pairs per query_batch call in batch mode, as main.cpp sends them.
+ * */
+
+std::atomic<long long> allocation_count(0);
+
+/**
+ * Every allocation is counted, through the plain, array and aligned forms
+ * of operator new alike; the array forms of new and delete call the plain
+ * ones, and the aligned ones take their memory from aligned_alloc. Once
+ * these are inlined GCC sees free called on memory from operator new and
+ * warns with -Wmismatched-new-delete, though that pairing is intended.
+ * */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void * operator new(size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void * p = malloc(size ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void * operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void * p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void * operator new(size_t size, std::align_val_t align)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    size_t alignment = (size_t) align;
+    size_t rounded = size == 0 ? alignment : (size + alignment - 1) / alignment * alignment;
+    #ifdef WIN32
+    void * p = _aligned_malloc(rounded, alignment);
+    #else
+    void * p = aligned_alloc(alignment, rounded);
+    #endif
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void * operator new[](size_t size, std::align_val_t align)
+{
+    return operator new(size, align);
+}
+
+void operator delete(void * p, std::align_val_t) noexcept
+{
+    #ifdef WIN32
+    _aligned_free(p);
+    #else
+    free(p);
+    #endif
+}
+
+void operator delete(void * p, size_t, std::align_val_t align) noexcept
+{
+    operator delete(p, align);
+}
+
+void operator delete[](void * p, std::align_val_t align) noexcept
+{
+    operator delete(p, align);
+}
+
+void operator delete[](void * p, size_t, std::align_val_t align) noexcept
+{
+    operator delete(p, align);
+}
+
+#pragma GCC diagnostic pop
+
+Metro * loadMetro(const char manifest[])
+{
+    if (manifest == NULL)
+        return new Metro(Metro::SUBWAY_NAME, 10);
+    Metro *metro = new Metro(NULL, 0);
+    if (!metro->load_manifest(manifest)) {
+        delete metro;
+        return NULL;
+    }
+    return metro;
+}
+
+double msSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - begin).count();
+}
+
+bool runMode(const char modes[], const char mode[])
+{
+    /**
+     * Whether mode is in the comma separated list modes, NULL meaning all.
+     * */
+    if (modes == NULL)
+        return true;
+    size_t length = strlen(mode);
+    for (const char * p = modes; p != NULL; p = strchr(p, ',')) {
+        if (*p == ',')
+            ++p;
+        if (strncmp(p, mode, length) == 0 && (p[length] == ',' || p[length] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+long peakRss()
+{
+    /**
+     * Peak resident set size of the process in KB, -1 if unknown.
+     * */
+    #ifdef WIN32
+    return -1;
+    #else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+    return usage.ru_maxrss;
+    #endif
+}
+
+struct BenchResult
+{
+    /**
+     * Checksum: Sum of the times of the routes answered, reported so that
+     *           the queries cannot be optimized away, and equal between
+     *           modes that answer alike.
+     * */
+    string mode, criterion;
+    long long queries, allocations, checksum;
+    double seconds, p50, p99, max;
+};
+
+vector<pair<int, int> > samplePairs(int n, int count)
+{
+    /**
+     * Every ordered pair of the n stations if count is 0, otherwise count
+     * random ones, the same on every run.
+     * */
+    vector<pair<int, int> > pairs;
+    if (count == 0) {
+        for (int s = 1; s <= n; ++s)
+            for (int t = 1; t <= n; ++t)
+                pairs.push_back(std::make_pair(s, t));
+        return pairs;
+    }
+    srand(1);
+    for (int i = 0; i < count; ++i)
+        pairs.push_back(std::make_pair(rand() % n + 1, rand() % n + 1));
+    return pairs;
+}
+
+BenchResult runBench(Metro * metro, const char mode[], int criterion, int repeat,
+        const vector<pair<int, int> > &pairs)
+{
+    vector<double> latency;
+    latency.reserve(pairs.size() * repeat);
+    long long checksum = 0;
+    long long allocations = allocation_count.load();
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    Route route;
+    for (int r = 0; r < repeat; ++r)
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            std::chrono::steady_clock::time_point a = std::chrono::steady_clock::now();
+            metro->query(pairs[i].first, pairs[i].second, CRITERION_NAME[criterion], route);
+            std::chrono::steady_clock::time_point b = std::chrono::steady_clock::now();
+            latency.push_back(std::chrono::duration<double, std::micro>(b - a).count());
+            checksum += route.cost_time;
+        }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    BenchResult res;
+    res.mode = mode;
+    res.criterion = CRITERION_NAME[criterion];
+    res.queries = latency.size();
+    res.allocations = allocation_count.load() - allocations;
+    res.seconds = std::chrono::duration<double>(end - begin).count();
+    sort(latency.begin(), latency.end());
+    res.p50 = latency.empty() ? 0 : latency[latency.size() / 2];
+    res.p99 = latency.empty() ? 0 : latency[latency.size() * 99 / 100];
+    res.max = latency.empty() ? 0 : latency.back();
+    res.checksum = checksum;
+    return res;
+}
+
+BenchResult runBatch(Metro * metro, int criterion, int repeat,
+        const vector<pair<int, int> > &pairs)
+{
+    /**
+     * Each batch keeps its own routes, as a caller reusing them would, so
+     * that a shorter last batch does not drop routes the next pass grows
+     * again. They are grown by a pass that is not measured.
+     * */
+    vector<vector<pair<int, int> > > batches;
+    for (size_t i = 0; i < pairs.size(); i += BENCH_BATCH)
+        batches.push_back(vector<pair<int, int> >(pairs.begin() + i,
+                    pairs.begin() + min(pairs.size(), i + BENCH_BATCH)));
+    vector<vector<Route> > routes(batches.size());
+    for (size_t i = 0; i < batches.size(); ++i)
+        metro->query_batch(batches[i], CRITERION_NAME[criterion], routes[i]);
+    vector<double> latency;
+    latency.reserve(pairs.size() * repeat);
+    long long checksum = 0;
+    long long allocations = allocation_count.load();
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; ++r)
+        for (size_t i = 0; i < batches.size(); ++i) {
+            std::chrono::steady_clock::time_point a = std::chrono::steady_clock::now();
+            metro->query_batch(batches[i], CRITERION_NAME[criterion], routes[i]);
+            std::chrono::steady_clock::time_point b = std::chrono::steady_clock::now();
+            double each = std::chrono::duration<double, std::micro>(b - a).count() /
+                batches[i].size();
+            for (size_t k = 0; k < batches[i].size(); ++k) {
+                latency.push_back(each);
+                checksum += routes[i][k].cost_time;
+            }
+        }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    BenchResult res;
+    res.mode = "batch";
+    res.criterion = CRITERION_NAME[criterion];
+    res.queries = latency.size();
+    res.allocations = allocation_count.load() - allocations;
+    res.seconds = std::chrono::duration<double>(end - begin).count();
+    sort(latency.begin(), latency.end());
+    res.p50 = latency.empty() ? 0 : latency[latency.size() / 2];
+    res.p99 = latency.empty() ? 0 : latency[latency.size() * 99 / 100];
+    res.max = latency.empty() ? 0 : latency.back();
+    res.checksum = checksum;
+    return res;
+}
+
+void printResult(const BenchResult &res)
+{
+    printf("  %-9s %-12s %10.0f q/s  p50 %8.2lf us  p99 %8.2lf us  "
+            "max %8.2lf us  %7.1lf alloc/q\n",
+            res.mode.c_str(), res.criterion.c_str(), res.queries / res.seconds,
+            res.p50, res.p99, res.max, (double)res.allocations / res.queries);
+}
+
+void writeJson(FILE * out, const vector<BenchResult> &results, double load_ms, long rss)
+{
+    fprintf(out, "{\"time\": %lld, \"load_ms\": %.3lf, \"peak_rss_kb\": %ld, \"runs\": [",
+            (long long)time(NULL), load_ms, rss);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &res = results[i];
+        fprintf(out, "%s{\"mode\": \"%s\", \"criterion\": \"%s\", \"queries\": %lld, "
+                "\"qps\": %.1lf, \"p50_us\": %.3lf, \"p99_us\": %.3lf, "
+                "\"max_us\": %.3lf, \"allocs_per_query\": %.3lf, \"checksum\": %lld}",
+                i ? ", " : "", res.mode.c_str(), res.criterion.c_str(), res.queries,
+                res.queries / res.seconds, res.p50, res.p99, res.max,
+                (double)res.allocations / res.queries, res.checksum);
+    }
+    fprintf(out, "]}\n");
+}
+
+int main(int argc, char **argv)
+{
+    int repeat = 1, numPair = 0;
+    const char * output = NULL, * manifest = NULL, * modes = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            manifest = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            numPair = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+            modes = argv[++i];
+        else {
+            printf("Usage: %s [-r repeat] [-o output] [-m manifest] [-p pairs] [-k modes]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (repeat < 1)
+        repeat = 1;
+    if (numPair < 0)
+        numPair = 0;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    Metro *metro = loadMetro(manifest);
+    if (metro == NULL) {
+        printf("Unable to load %s\n", manifest);
+        return 1;
+    }
+    double load_ms = msSince(begin);
+    int n = metro->list_all_stations().size();
+    printf("  load      %.3lf ms, %d stations\n", load_ms, n);
+    vector<pair<int, int> > pairs = samplePairs(n, numPair);
+
+    vector<BenchResult> results;
+    if (runMode(modes, "search"))
+        for (int c = 0; c < NUM_CRITERION; ++c) {
+            results.push_back(runBench(metro, "search", c, repeat, pairs));
+            printResult(results.back());
+        }
+    if (runMode(modes, "batch")) {
+        printf("  batch     %d threads\n", (int) thread::hardware_concurrency());
+        for (int c = 0; c < NUM_CRITERION; ++c) {
+            results.push_back(runBatch(metro, c, repeat, pairs));
+            printResult(results.back());
+        }
+    }
+    if (runMode(modes, "landmark")) {
+        Metro *landmarks = loadMetro(manifest);
+        begin = std::chrono::steady_clock::now();
+        landmarks->precompute_landmarks();
+        printf("  landmark  %.3lf ms\n", msSince(begin));
+        for (int c = CRITERION_TIME; c <= CRITERION_DISTANCE; ++c) {
+            results.push_back(runBench(landmarks, "landmark", c, repeat, pairs));
+            printResult(results.back());
+        }
+        delete landmarks;
+    }
+    if (runMode(modes, "hierarchy")) {
+        Metro *hierarchy = loadMetro(manifest);
+        begin = std::chrono::steady_clock::now();
+        hierarchy->precompute_hierarchy();
+        printf("  hierarchy %.3lf ms\n", msSince(begin));
+        for (int c = CRITERION_TIME; c <= CRITERION_DISTANCE; ++c) {
+            results.push_back(runBench(hierarchy, "hierarchy", c, repeat, pairs));
+            printResult(results.back());
+        }
+        delete hierarchy;
+    }
+    begin = std::chrono::steady_clock::now();
+    if (!runMode(modes, "table"))
+        ;
+    else if (metro->precompute_routes()) {
+        printf("  tables    %.3lf ms\n", msSince(begin));
+        for (int c = 0; c < NUM_CRITERION; ++c) {
+            results.push_back(runBench(metro, "table", c, repeat, pairs));
+            printResult(results.back());
+        }
+    } else
+        printf("  tables    skipped, %.1lf MB needed\n",
+                metro->route_table_bytes() / 1048576.0);
+    long rss = peakRss();
+    printf("  peak rss  %ld KB\n", rss);
+
+    if (output != NULL) {
+        FILE * out = fopen(output, "a");
+        if (out == NULL) {
+            printf("Unable to write %s\n", output);
+            return 1;
+        }
+        writeJson(out, results, load_ms, rss);
+        fclose(out);
+    }
+    delete metro;
+    return 0;
+}
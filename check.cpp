@@ -0,0 +1,594 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <set>
+
+#include "metro.cpp"
+
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+/**
+ * Consistency checker: answers from the route tables, the landmark search
+ * and the contraction hierarchy must cost what the plain search gives,
+ * money routes must not come back to a station or ride a line for no
+ * station, one-to-all trees must route as query does, and all of it must
+ * still hold under random closures, reopenings and delays. Money answers
+ * are also checked against an oracle that knows nothing of the searches:
+ * it prices every simple path of small random networks by the fare rules.
+ * Prints each failure and exits with 1 if there is any.
+ * Usage: metro_check [-m manifest] [-p pairs] [-s steps] [-f networks] [-d dir]
+ *   -m: Check the lines of this manifest instead of the shipped network.
+ *   -p: Check this many random pairs instead of all of them, for large
+ *       networks; also the pairs checked after each disruption, 200 by
+ *       default.
+ *   -s: Number of random disruptions, 200 by default.
+ *   -f: Number of random networks the fare oracle checks, 300 by default.
+ *   -d: Directory the oracle writes its networks to, "check_network" by
+ *       default.
+ * */
+
+#define CHECK_MAX_REPORT (10)
+/**
+ * Failures printed per check, the rest are only counted.
+ * */
+
+#define CHECK_TREE_START (20)
+/**
+ * Starts whose one-to-all trees are checked when pairs are sampled; all
+ * of them otherwise.
+ * */
+
+#define CHECK_FARE_STATION (12)
+#define CHECK_FARE_LINE (5)
+/**
+ * Stations and lines of each network of the fare oracle, few enough for
+ * every simple path to be tried.
+ * */
+
+#define CHECK_BUDGET (6)
+/**
+ * Fare in RMB the reachable stations are checked within.
+ * */
+
+struct Checked
+{
+    const char * name;
+    Metro * metro;
+};
+
+long long failures = 0;
+
+void fail(const char name[], const char what[], int start, int end, const char criterion[])
+{
+    if (++failures <= CHECK_MAX_REPORT)
+        printf("  FAIL %s: %s from %d to %d by %s\n", name, what, start, end, criterion);
+}
+
+Metro * loadMetro(const char manifest[])
+{
+    if (manifest == NULL)
+        return new Metro(Metro::SUBWAY_NAME, 10);
+    Metro *metro = new Metro(NULL, 0);
+    if (!metro->load_manifest(manifest) || metro->num_station() == 0) {
+        delete metro;
+        return NULL;
+    }
+    return metro;
+}
+
+vector<pair<int, int> > samplePairs(int n, int count, unsigned seed)
+{
+    /**
+     * Every ordered pair of the n stations if count is 0, otherwise count
+     * random ones.
+     * */
+    vector<pair<int, int> > pairs;
+    if (count == 0) {
+        for (int s = 1; s <= n; ++s)
+            for (int t = 1; t <= n; ++t)
+                pairs.push_back(std::make_pair(s, t));
+        return pairs;
+    }
+    srand(seed);
+    for (int i = 0; i < count; ++i)
+        pairs.push_back(std::make_pair(rand() % n + 1, rand() % n + 1));
+    return pairs;
+}
+
+bool sameCost(const Route &a, const Route &b, int criterion)
+{
+    /**
+     * Whether two answers cost the same by the criterion they were asked
+     * for; ties may be broken either way.
+     * */
+    switch (criterion) {
+        case CRITERION_TIME:
+            return a.cost_time == b.cost_time;
+        case CRITERION_DISTANCE:
+            return fabs(a.distance - b.distance) < 1e-6;
+        case CRITERION_MONEY:
+            return a.money == b.money;
+        default:
+            return a.num_segment() == b.num_segment() && a.cost_time == b.cost_time;
+    }
+}
+
+const char * routeFault(const Route &route)
+{
+    /**
+     * Why a money route is wrong, NULL if it is not: it must pass every
+     * station once and ride at least one section on each line it takes.
+     * */
+    vector<int> stations;
+    for (int i = 0; i < route.num_segment(); ++i) {
+        if (route.segment_begin[i + 1] - route.segment_begin[i] < 2)
+            return "one-station segment";
+        for (int j = route.segment_begin[i]; j < route.segment_begin[i + 1]; ++j)
+            if (stations.empty() || stations.back() != route.station[j])
+                stations.push_back(route.station[j]);
+    }
+    sort(stations.begin(), stations.end());
+    if (adjacent_find(stations.begin(), stations.end()) != stations.end())
+        return "station revisited";
+    return NULL;
+}
+
+const char * responseFault(const Response &response, const Metro * metro)
+{
+    /**
+     * RouteFault of a Response, from the station names of its path.
+     * */
+    Route route;
+    route.segment_begin.push_back(0);
+    for (size_t i = 0; i < response.path.size(); ++i) {
+        for (size_t j = 0; j < response.path[i].second.size(); ++j)
+            route.station.push_back(metro->query_station_index(response.path[i].second[j]));
+        route.segment_line.push_back(0);
+        route.segment_begin.push_back(route.station.size());
+    }
+    return routeFault(route);
+}
+
+const char * disruptionFault(const Route &route, const set<int> &closedStations,
+        const set<pair<int, int> > &closedSections)
+{
+    /**
+     * Why a route is wrong under the disruptions, NULL if it is not.
+     * */
+    for (int i = 0; i < route.num_segment(); ++i)
+        for (int j = route.segment_begin[i]; j < route.segment_begin[i + 1]; ++j) {
+            if (closedStations.count(route.station[j]))
+                return "closed station used";
+            if (j > route.segment_begin[i] && closedSections.count(
+                        std::make_pair(route.station[j - 1], route.station[j])))
+                return "closed section used";
+        }
+    return NULL;
+}
+
+void checkPairs(Metro * plain, const vector<Checked> &checked,
+        const vector<pair<int, int> > &pairs, const set<int> &closedStations,
+        const set<pair<int, int> > &closedSections)
+{
+    /**
+     * Ask every pair of every criterion of plain and of each checked
+     * Metro, and compare.
+     * */
+    Route truth, route;
+    for (size_t i = 0; i < pairs.size(); ++i)
+        for (int c = 0; c < NUM_CRITERION; ++c) {
+            int s = pairs[i].first, t = pairs[i].second;
+            plain->query(s, t, CRITERION_NAME[c], truth);
+            const char * fault = disruptionFault(truth, closedStations, closedSections);
+            if (fault == NULL && c == CRITERION_MONEY)
+                fault = routeFault(truth);
+            if (fault != NULL)
+                fail("search", fault, s, t, CRITERION_NAME[c]);
+            for (size_t k = 0; k < checked.size(); ++k) {
+                checked[k].metro->query(s, t, CRITERION_NAME[c], route);
+                if (!sameCost(route, truth, c))
+                    fail(checked[k].name, "cost differs from search", s, t, CRITERION_NAME[c]);
+                fault = disruptionFault(route, closedStations, closedSections);
+                if (fault == NULL && c == CRITERION_MONEY)
+                    fault = routeFault(route);
+                if (fault != NULL)
+                    fail(checked[k].name, fault, s, t, CRITERION_NAME[c]);
+            }
+        }
+}
+
+bool sameAnswer(const Response &tree, const Route &route, int criterion)
+{
+    switch (criterion) {
+        case CRITERION_TIME:
+            return tree.cost_time == route.cost_time;
+        case CRITERION_DISTANCE:
+            return fabs(tree.distance - route.distance) < 1e-6;
+        case CRITERION_MONEY:
+            return tree.money == route.money;
+        default:
+            return (int) tree.path.size() == route.num_segment() &&
+                tree.cost_time == route.cost_time;
+    }
+}
+
+void checkTrees(Metro * plain, const vector<int> &starts)
+{
+    /**
+     * Routes of one-to-all trees must cost what query answers, money
+     * routes keeping their shape, and a money budget must keep exactly
+     * the stations query prices within it.
+     * */
+    Route route;
+    for (size_t i = 0; i < starts.size(); ++i) {
+        int s = starts[i];
+        ShortestPathTree budget = plain->query_reachable(s, CHECK_BUDGET, "Money");
+        for (int c = 0; c < NUM_CRITERION; ++c) {
+            ShortestPathTree tree = plain->query_all_from(s, CRITERION_NAME[c]);
+            for (int t = 1; t <= plain->num_station(); ++t) {
+                plain->query(s, t, CRITERION_NAME[c], route);
+                Response answer = plain->query_tree_route(tree, t);
+                if (!sameAnswer(answer, route, c))
+                    fail("tree", "cost differs from query", s, t, CRITERION_NAME[c]);
+                if (c == CRITERION_MONEY && responseFault(answer, plain) != NULL)
+                    fail("tree", responseFault(answer, plain), s, t, CRITERION_NAME[c]);
+                if (c == CRITERION_MONEY && (route.money <= CHECK_BUDGET) != (budget.target[t] != -1))
+                    fail("reachable", "budget differs from query", s, t, CRITERION_NAME[c]);
+            }
+        }
+    }
+}
+
+void checkPareto(Metro * plain, const vector<pair<int, int> > &pairs)
+{
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        vector<Response> routes = plain->query_pareto(pairs[i].first, pairs[i].second);
+        for (size_t k = 0; k < routes.size(); ++k) {
+            const char * fault = responseFault(routes[k], plain);
+            if (fault != NULL)
+                fail("pareto", fault, pairs[i].first, pairs[i].second, "Pareto");
+        }
+    }
+}
+
+struct FareEdge
+{
+    /**
+     * A section of the oracle's network, in 0.01 km.
+     * */
+    int to, distance;
+    string line;
+    bool fareFree;
+};
+
+int fareRule(int distance)
+{
+    /**
+     * Fare of a charge segment of distance in 0.01 km: 2 RMB up to 4 km,
+     * then 1 RMB more for every 4 km started up to 12 km, every 6 km up to
+     * 24 km and every 8 km beyond.
+     * */
+    int fare = 2;
+    for (int km = 400, step = 400; distance > km; km += step) {
+        ++fare;
+        if (km >= 2400)
+            step = 800;
+        else if (km >= 1200)
+            step = 600;
+    }
+    return fare;
+}
+
+void rideFare(const FareEdge &edge, int &paid, int &open)
+{
+    /**
+     * Ride edge: a fare-free line pays the open charge segment, less the
+     * 2 RMB paid again with the next one, and opens a new segment.
+     * */
+    if (edge.fareFree) {
+        paid += fareRule(open) - 2;
+        open = 0;
+    } else
+        open += edge.distance;
+}
+
+void enumerateFares(const vector<vector<FareEdge> > &adj, int u, int paid, int open,
+        vector<bool> &visited, vector<int> &best)
+{
+    /**
+     * Lowest fare to every station over every simple path from u onwards,
+     * into best.
+     * */
+    visited[u] = true;
+    for (size_t i = 0; i < adj[u].size(); ++i) {
+        const FareEdge &edge = adj[u][i];
+        if (visited[edge.to])
+            continue;
+        int nowPaid = paid, nowOpen = open;
+        rideFare(edge, nowPaid, nowOpen);
+        best[edge.to] = min(best[edge.to], nowPaid + fareRule(nowOpen));
+        enumerateFares(adj, edge.to, nowPaid, nowOpen, visited, best);
+    }
+    visited[u] = false;
+}
+
+bool makeDirectory(const string &name)
+{
+    #ifdef WIN32
+    return _mkdir(name.c_str()) == 0 || errno == EEXIST;
+    #else
+    return mkdir(name.c_str(), 0755) == 0 || errno == EEXIST;
+    #endif
+}
+
+bool writeFareNetwork(const string &directory, vector<vector<FareEdge> > &adj)
+{
+    /**
+     * Write a random network of CHECK_FARE_LINE lines over
+     * CHECK_FARE_STATION stations, the last one a fare-free APM line,
+     * each line after the first starting on a station of an earlier one,
+     * and its sections into adj. Sections are 0.3 to 9 km, so that routes
+     * cross every fare step. No two lines run between the same pair of
+     * stations, as the network keeps one section per pair.
+     * */
+    #ifdef WIN32
+    string separator = "\\";
+    #else
+    string separator = "/";
+    #endif
+    adj.assign(CHECK_FARE_STATION + 1, vector<FareEdge>());
+    FILE * manifest = fopen((directory + separator + "manifest.txt").c_str(), "w");
+    if (manifest == NULL)
+        return false;
+    vector<int> used;
+    for (int l = 0; l < CHECK_FARE_LINE; ++l) {
+        bool fareFree = l == CHECK_FARE_LINE - 1;
+        char name[16];
+        sprintf(name, fareFree ? "APM" : "L%d", l + 1);
+        int length = fareFree ? 2 + rand() % 2 : 3 + rand() % 3;
+        vector<int> stops;
+        if (!used.empty())
+            stops.push_back(used[rand() % used.size()]);
+        for (int tries = 0; (int) stops.size() < length && tries < 100; ++tries) {
+            int u = rand() % CHECK_FARE_STATION + 1;
+            bool section = false;
+            for (size_t i = 0; !stops.empty() && i < adj[stops.back()].size(); ++i)
+                section = section || adj[stops.back()][i].to == u;
+            if (!section && find(stops.begin(), stops.end(), u) == stops.end())
+                stops.push_back(u);
+        }
+        length = stops.size();
+        if (length < 2)
+            continue;
+        FILE * out = fopen((directory + separator + name + ".txt").c_str(), "w");
+        if (out == NULL) {
+            fclose(manifest);
+            return false;
+        }
+        vector<int> distance(length, 0);
+        for (int i = 0, time = 0; i < length; ++i) {
+            fprintf(out, "F%d %d\n", stops[i], time);
+            time += rand() % 5 + 1;
+            distance[i] = fareFree ? rand() % 120 + 30 : rand() % 870 + 30;
+        }
+        fprintf(out, "\n");
+        for (int i = 0; i < length; ++i) {
+            if (i + 1 == length) {
+                fprintf(out, "F%d\n", stops[i]);
+                break;
+            }
+            fprintf(out, "F%d %d.%02d\n", stops[i], distance[i] / 100, distance[i] % 100);
+            FareEdge edge = {stops[i + 1], distance[i], name, fareFree};
+            adj[stops[i]].push_back(edge);
+            edge.to = stops[i];
+            adj[stops[i + 1]].push_back(edge);
+        }
+        fclose(out);
+        fprintf(manifest, "%s\n", name);
+        used.insert(used.end(), stops.begin(), stops.end());
+    }
+    fclose(manifest);
+    return true;
+}
+
+int responseFare(const Response &response, const vector<vector<FareEdge> > &adj)
+{
+    /**
+     * Fare of the route of response by the oracle, -1 if it rides a
+     * section the network does not have.
+     * */
+    int paid = 0, open = 0;
+    for (size_t i = 0; i < response.path.size(); ++i) {
+        const vector<string> &stations = response.path[i].second;
+        for (size_t j = 1; j < stations.size(); ++j) {
+            int u = atoi(stations[j - 1].c_str() + 1), v = atoi(stations[j].c_str() + 1);
+            const FareEdge * ridden = NULL;
+            for (size_t k = 0; k < adj[u].size() && ridden == NULL; ++k)
+                if (adj[u][k].to == v && adj[u][k].line == response.path[i].first)
+                    ridden = &adj[u][k];
+            if (ridden == NULL)
+                return -1;
+            rideFare(*ridden, paid, open);
+        }
+    }
+    return paid + fareRule(open);
+}
+
+void checkFares(const string &directory, int numNetwork)
+{
+    /**
+     * The money answers of the search and of the route tables on
+     * numNetwork random networks must be the lowest fare of any simple
+     * path, and must be what the oracle prices their own route at.
+     * */
+    srand(3);
+    long long before = failures, numPair = 0;
+    for (int k = 0; k < numNetwork; ++k) {
+        vector<vector<FareEdge> > adj;
+        if (!makeDirectory(directory) || !writeFareNetwork(directory, adj)) {
+            printf("Unable to write %s\n", directory.c_str());
+            ++failures;
+            return;
+        }
+        Metro plain(NULL, 0), tables(NULL, 0);
+        plain.load_manifest(directory + "/manifest.txt");
+        tables.load_manifest(directory + "/manifest.txt");
+        tables.precompute_routes();
+        vector<Metro *> metros;
+        metros.push_back(&plain), metros.push_back(&tables);
+        for (int s = 1; s <= CHECK_FARE_STATION; ++s) {
+            char name[16];
+            sprintf(name, "F%d", s);
+            int start = plain.query_station_index(name);
+            if (start == -1)
+                continue;
+            vector<int> best(CHECK_FARE_STATION + 1, INF);
+            vector<bool> visited(CHECK_FARE_STATION + 1, false);
+            enumerateFares(adj, s, 0, 0, visited, best);
+            for (int t = 1; t <= CHECK_FARE_STATION; ++t) {
+                sprintf(name, "F%d", t);
+                int end = plain.query_station_index(name);
+                if (end == -1 || t == s)
+                    continue;
+                ++numPair;
+                for (size_t m = 0; m < metros.size(); ++m) {
+                    const char * what = m == 0 ? "fare search" : "fare table";
+                    Response answer = metros[m]->query(start, end, "Money");
+                    if (best[t] == INF) {
+                        if (!answer.path.empty())
+                            fail(what, "route to an unreachable station", s, t, "Money");
+                        continue;
+                    }
+                    if (answer.money != best[t])
+                        fail(what, "fare is not the lowest", s, t, "Money");
+                    if (responseFare(answer, adj) != answer.money)
+                        fail(what, "fare differs from its route", s, t, "Money");
+                }
+            }
+        }
+    }
+    printf("fare oracle: %d networks, %lld pairs: %lld failures\n", numNetwork, numPair,
+            failures - before);
+}
+
+int main(int argc, char **argv)
+{
+    int numPair = 0, numStep = 200, numStepPair = 200, numNetwork = 300;
+    const char * manifest = NULL, * directory = "check_network";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            manifest = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            numPair = numStepPair = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            numStep = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            numNetwork = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            directory = argv[++i];
+        else {
+            printf("Usage: %s [-m manifest] [-p pairs] [-s steps] [-f networks] [-d dir]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    Metro *plain = loadMetro(manifest);
+    if (plain == NULL) {
+        printf("Unable to load %s\n", manifest);
+        return 1;
+    }
+    vector<Checked> checked;
+    Checked tables = {"tables", loadMetro(manifest)};
+    if (tables.metro->precompute_routes()) {
+        tables.metro->enable_cache(1 << 16);
+        checked.push_back(tables);
+    } else
+        printf("tables skipped, %.1lf MB needed\n", tables.metro->route_table_bytes() / 1048576.0);
+    Checked landmarks = {"landmarks", loadMetro(manifest)};
+    landmarks.metro->precompute_landmarks();
+    checked.push_back(landmarks);
+    Checked hierarchy = {"hierarchy", loadMetro(manifest)};
+    hierarchy.metro->precompute_hierarchy();
+    checked.push_back(hierarchy);
+
+    int n = plain->num_station();
+    set<int> closedStations;
+    set<pair<int, int> > closedSections;
+    vector<pair<int, int> > pairs = samplePairs(n, numPair, 1);
+    printf("network %d stations, %d pairs\n", n, (int) pairs.size());
+    checkPairs(plain, checked, pairs, closedStations, closedSections);
+    checkPareto(plain, pairs);
+    vector<int> starts;
+    for (int s = 1; s <= n; ++s)
+        if (numPair == 0 || s <= CHECK_TREE_START)
+            starts.push_back(s);
+    checkTrees(plain, starts);
+    printf("loaded network: %lld failures\n", failures);
+
+    /**
+     * Random disruptions, the same on every Metro, each followed by a
+     * check of fresh random pairs. Closing a station or section that is
+     * closed, or reopening one that is open, is allowed and checked too.
+     * */
+    vector<Metro *> all(1, plain);
+    for (size_t k = 0; k < checked.size(); ++k)
+        all.push_back(checked[k].metro);
+    srand(2);
+    long long before = failures;
+    for (int step = 0; step < numStep; ++step) {
+        int u = rand() % n + 1, kind = rand() % 6, minutes = rand() % 8;
+        int v = 0;
+        if (kind >= 2) {
+            Route route;
+            plain->query(u, rand() % n + 1, "Time", route);
+            if (route.station.size() < 2 || route.station[0] == route.station[1])
+                continue;
+            v = route.station[1];
+        }
+        for (size_t k = 0; k < all.size(); ++k)
+            switch (kind) {
+                case 0: all[k]->close_station(u); break;
+                case 1: all[k]->reopen_station(u); break;
+                case 2: all[k]->close_section(u, v); break;
+                case 3: all[k]->reopen_section(u, v); break;
+                default: all[k]->slow_section(u, v, minutes);
+            }
+        if (kind == 0)
+            closedStations.insert(u);
+        else if (kind == 1)
+            closedStations.erase(u);
+        else if (kind == 2)
+            closedSections.insert(std::make_pair(u, v)), closedSections.insert(std::make_pair(v, u));
+        else if (kind == 3)
+            closedSections.erase(std::make_pair(u, v)), closedSections.erase(std::make_pair(v, u));
+        if (step == numStep / 2) {
+            for (size_t k = 0; k < all.size(); ++k)
+                all[k]->clear_disruptions();
+            closedStations.clear(), closedSections.clear();
+        }
+        checkPairs(plain, checked, samplePairs(n, numStepPair, step + 3),
+                closedStations, closedSections);
+    }
+    printf("%d random disruptions: %lld failures\n", numStep, failures - before);
+
+    before = failures;
+    for (size_t k = 0; k < all.size(); ++k)
+        all[k]->clear_disruptions();
+    closedStations.clear(), closedSections.clear();
+    checkPairs(plain, checked, pairs, closedStations, closedSections);
+    printf("disruptions cleared: %lld failures\n", failures - before);
+
+    checkFares(directory, numNetwork);
+
+    printf(failures == 0 ? "OK\n" : "FAILED\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,295 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using std::map;
+using std::pair;
+using std::set;
+using std::string;
+using std::vector;
+
+/**
+ * Synthetic network generator: writes a network of any size in the format
+ * of the files under data, with a manifest listing its lines, for scale
+ * and stress testing. Load it with Metro::load_manifest or
+ * main --manifest DIR/manifest.txt.
+ * Usage: metro_generate [-o dir] [-l lines] [-s stations] [-i density]
+ *                       [-a apm] [-r seed]
+ *   -o: Output directory, "synthetic" by default.
+ *   -l: Number of lines, APM lines included, 20 by default.
+ *   -s: Number of stations, up to 100000, 1000 by default.
+ *   -i: Share of stops that are interchanges with a line laid before,
+ *       0.15 by default.
+ *   -a: Number of short fare-free lines, named APM, APM2, ..., 1 by default.
+ *   -r: Random seed, 1 by default. The same options give the same network.
+ * Stations are about 1 km apart on a square of one station per km^2. Every
+ * line but the first starts at a station of an earlier one, so the
+ * network is connected. The distance block of every other line is written
+ * from the far end, as some of the shipped files are.
+ * */
+
+#define GENERATE_MAX_STATION (100000)
+#define GENERATE_CELL (2.0)
+#define GENERATE_APM_STOP (8)
+
+struct Point
+{
+    double x, y;
+};
+
+struct Line
+{
+    string name;
+    vector<int> stops;
+    bool fareFree;
+};
+
+struct Generator
+{
+    std::mt19937 random;
+    double side;
+    vector<Point> station;
+    map<pair<int, int>, vector<int> > cell;
+    set<pair<int, int> > section;
+
+    double uniform(double low, double high)
+    {
+        return std::uniform_real_distribution<double>(low, high)(random);
+    }
+
+    pair<int, int> cellOf(const Point &p)
+    {
+        return std::make_pair((int)floor(p.x / GENERATE_CELL), (int)floor(p.y / GENERATE_CELL));
+    }
+
+    int addStation(const Point &p)
+    {
+        station.push_back(p);
+        cell[cellOf(p)].push_back(station.size() - 1);
+        return station.size() - 1;
+    }
+
+    int nearStation(const Point &p, const set<int> &used, int last)
+    {
+        /**
+         * The nearest station to p within a cell of it that the line has
+         * not stopped at and that would not repeat a section of another
+         * line, -1 if there is none.
+         * */
+        pair<int, int> c = cellOf(p);
+        int best = -1;
+        double bestDistance = 0;
+        for (int dx = -1; dx <= 1; ++dx)
+            for (int dy = -1; dy <= 1; ++dy) {
+                map<pair<int, int>, vector<int> >::iterator it =
+                    cell.find(std::make_pair(c.first + dx, c.second + dy));
+                if (it == cell.end())
+                    continue;
+                for (size_t i = 0; i < it->second.size(); ++i) {
+                    int u = it->second[i];
+                    if (used.count(u) || section.count(std::make_pair(last, u)))
+                        continue;
+                    double d = hypot(station[u].x - p.x, station[u].y - p.y);
+                    if (best == -1 || d < bestDistance)
+                        best = u, bestDistance = d;
+                }
+            }
+        return best;
+    }
+
+    Line layLine(const string &name, int newStations, int maxStops, double density, bool fareFree)
+    {
+        /**
+         * Lay a line as a random walk, adding newStations stations and
+         * stopping at existing ones near the walk with probability density.
+         * */
+        Line line;
+        line.name = name, line.fareFree = fareFree;
+        set<int> used;
+        Point p;
+        if (station.empty()) {
+            p.x = uniform(0, side), p.y = uniform(0, side);
+            line.stops.push_back(addStation(p));
+            --newStations;
+        } else {
+            int u = std::uniform_int_distribution<int>(0, station.size() - 1)(random);
+            line.stops.push_back(u);
+            p = station[u];
+        }
+        used.insert(line.stops[0]);
+
+        double heading = uniform(0, 2 * M_PI), step = fareFree ? 0.6 : 1.2;
+        while (newStations > 0 && (int)line.stops.size() < maxStops) {
+            heading += uniform(-0.4, 0.4);
+            Point next = p;
+            next.x += cos(heading) * step * uniform(0.7, 1.4);
+            next.y += sin(heading) * step * uniform(0.7, 1.4);
+            if (next.x < 0 || next.x > side || next.y < 0 || next.y > side) {
+                heading += M_PI;
+                continue;
+            }
+            int last = line.stops.back(), u = -1;
+            if (uniform(0, 1) < density)
+                u = nearStation(next, used, last);
+            if (u == -1) {
+                u = addStation(next);
+                --newStations;
+            }
+            section.insert(std::make_pair(last, u));
+            section.insert(std::make_pair(u, last));
+            used.insert(u);
+            line.stops.push_back(u);
+            p = station[u];
+        }
+        return line;
+    }
+};
+
+bool makeDirectory(const string &name)
+{
+    #ifdef WIN32
+    return _mkdir(name.c_str()) == 0 || errno == EEXIST;
+    #else
+    return mkdir(name.c_str(), 0755) == 0 || errno == EEXIST;
+    #endif
+}
+
+bool writeLine(const string &directory, const Line &line, const vector<Point> &station, bool reverse)
+{
+    /**
+     * Write line as DIRECTORY/NAME.txt: each stop with the minutes from the
+     * first one, an empty line, then each stop with the km to the next.
+     * */
+    #ifdef WIN32
+    string filename = directory + "\\" + line.name + ".txt";
+    #else
+    string filename = directory + "/" + line.name + ".txt";
+    #endif
+    FILE * out = fopen(filename.c_str(), "w");
+    if (out == NULL)
+        return false;
+    int n = line.stops.size(), time = 0;
+    vector<double> distance(n, 0);
+    for (int i = 0; i + 1 < n; ++i) {
+        const Point &a = station[line.stops[i]], &b = station[line.stops[i + 1]];
+        distance[i] = floor(hypot(a.x - b.x, a.y - b.y) * 100 + 0.5) / 100;
+        if (distance[i] < 0.3)
+            distance[i] = 0.3;
+    }
+    for (int i = 0; i < n; ++i) {
+        fprintf(out, "S%06d %d\n", line.stops[i] + 1, time);
+        if (i + 1 < n)
+            time += (int)ceil(distance[i] / (line.fareFree ? 25.0 : 40.0) * 60) + 1;
+    }
+    fprintf(out, "\n");
+    for (int k = 0; k < n; ++k) {
+        int i = reverse ? n - 1 - k : k;
+        bool last = k == n - 1;
+        if (last)
+            fprintf(out, "S%06d\n", line.stops[i] + 1);
+        else
+            fprintf(out, "S%06d %.2lf\n", line.stops[i] + 1, distance[reverse ? i - 1 : i]);
+    }
+    return fclose(out) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    string directory = "synthetic";
+    int numLine = 20, numStation = 1000, numApm = 1, seed = 1;
+    double density = 0.15;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            directory = argv[++i];
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            numLine = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            numStation = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+            density = atof(argv[++i]);
+        else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+            numApm = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            seed = atoi(argv[++i]);
+        else {
+            printf("Usage: %s [-o dir] [-l lines] [-s stations] [-i density] [-a apm] [-r seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (numLine < 1 || numApm < 0 || numApm >= numLine || density < 0 || density >= 1
+            || numStation < 2 * numLine || numStation > GENERATE_MAX_STATION) {
+        printf("Need 0 <= apm < lines, 0 <= density < 1 and 2 * lines <= stations <= %d\n",
+                GENERATE_MAX_STATION);
+        return 1;
+    }
+
+    Generator generator;
+    generator.random.seed(seed);
+    generator.side = sqrt((double)numStation);
+    vector<Line> lines;
+    int numRegular = numLine - numApm, apmStations = 0;
+    for (int l = 0; l < numApm; ++l)
+        apmStations += std::min(GENERATE_APM_STOP - 2, numStation / numLine);
+    int left = numStation - apmStations;
+    for (int l = 0; l < numRegular; ++l) {
+        int share = left / (numRegular - l);
+        char name[32];
+        sprintf(name, "Line%d", l + 1);
+        lines.push_back(generator.layLine(name, share, numStation, density, false));
+        left -= share;
+    }
+    for (int l = 0; l < numApm; ++l) {
+        char name[32];
+        if (l == 0)
+            sprintf(name, "APM");
+        else
+            sprintf(name, "APM%d", l + 1);
+        int share = std::min(GENERATE_APM_STOP - 2, numStation / numLine);
+        lines.push_back(generator.layLine(name, share, GENERATE_APM_STOP, 0, true));
+    }
+
+    if (!makeDirectory(directory)) {
+        printf("Unable to create %s\n", directory.c_str());
+        return 1;
+    }
+    #ifdef WIN32
+    string manifest = directory + "\\manifest.txt";
+    #else
+    string manifest = directory + "/manifest.txt";
+    #endif
+    FILE * out = fopen(manifest.c_str(), "w");
+    if (out == NULL) {
+        printf("Unable to write %s\n", manifest.c_str());
+        return 1;
+    }
+    fprintf(out, "# metro_generate -l %d -s %d -i %.3lf -a %d -r %d\n",
+            numLine, numStation, density, numApm, seed);
+    size_t numStop = 0;
+    for (size_t l = 0; l < lines.size(); ++l) {
+        if (!writeLine(directory, lines[l], generator.station, l % 2 == 1)) {
+            printf("Unable to write line %s\n", lines[l].name.c_str());
+            return 1;
+        }
+        fprintf(out, "%s\n", lines[l].name.c_str());
+        numStop += lines[l].stops.size();
+    }
+    fclose(out);
+    printf("%s: %zu lines, %zu stations, %zu interchange stops\n", manifest.c_str(),
+            lines.size(), generator.station.size(), numStop - generator.station.size());
+    return 0;
+}
@@ -0,0 +1,682 @@
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define HIERARCHY_WITNESS_LIMIT (500)
+/**
+ * Most nodes a witness search settles while contracting a node. A search
+ * cut short only adds a shortcut that is not needed, never a wrong one.
+ * */
+
+#define HIERARCHY_WITNESS_HOPS (10)
+/**
+ * Most edges a witness search goes from its source, cut short the same
+ * way. Witnesses are nearly always a few edges long.
+ * */
+
+#define HIERARCHY_MAGIC "METROCHX"
+#define HIERARCHY_VERSION (1)
+
+struct HierarchyArc {
+    /**
+     * An edge of the hierarchy as seen from one of its ends.
+     * Weight: Its weight. Node: Position of the other end.
+     * Edge: Index of the edge, to unpack it.
+     * */
+    long long weight;
+    int node, edge;
+};
+
+/**
+ * Every flat array of a contraction hierarchy, as (element type, name).
+ * Nodes are stored by position, their rank in the contraction order, so
+ * that the few important nodes every query reaches lie together.
+ * Rank: Position of each node of the graph, higher is more important.
+ * Up_begin, Up: Edges leaving the node at position p towards higher
+ *               positions are up[up_begin[p]] to up[up_begin[p + 1] - 1].
+ * Down_begin, Down: Edges entering the node at position p from higher
+ *                   positions, stored the same way.
+ * Edge_first, Edge_second: For a shortcut, the two edges it replaces, in
+ *                          route order. For an original arc, the arc and -1.
+ * The order is the order of the sections of a hierarchy file.
+ * */
+#define HIERARCHY_ARRAYS(X) \
+    X(int, rank) \
+    X(int, up_begin) \
+    X(HierarchyArc, up) \
+    X(int, down_begin) \
+    X(HierarchyArc, down) \
+    X(int, edge_first) \
+    X(int, edge_second)
+
+#define NUM_HIERARCHY_ARRAY (0 HIERARCHY_ARRAYS(COUNT_ARRAY))
+
+struct HierarchyWorkspace {
+    /**
+     * Buffers of a ContractionHierarchy search, kept between queries. Only
+     * the positions a query touched are reset by the next one.
+     * Key, Parent, Pre: Best weight of each position from the sources (0)
+     *                   or to the targets (1), the position it was reached
+     *                   from and the edge it was reached by.
+     * Settled, Relaxed, Pushed, Repushed: Positions expanded, edges looked
+     *                                     at, heap entries added and those
+     *                                     of them for a position already
+     *                                     reached, over every search since
+     *                                     the caller last cleared them.
+     * Climb: The upward edges of the route found, from unpack_route.
+     * */
+    std::vector<long long> key[2];
+    std::vector<int> parent[2], pre[2];
+    std::vector<int> touched, climb;
+    std::vector<std::pair<long long, int> > heap[2];
+    long long settled, relaxed, pushed, repushed;
+
+    HierarchyWorkspace() {
+        settled = relaxed = pushed = repushed = 0;
+    }
+};
+
+struct ContractionHierarchy {
+    /**
+     * A contraction hierarchy of a directed graph with additive integer
+     * weights. Nodes are contracted one by one, least important first;
+     * contracting a node adds a shortcut between two of its neighbours
+     * wherever the route through it is the only shortest one, so a
+     * shortest route always climbs the ranks and then descends. A query
+     * searches only upward from both ends and meets at the top.
+     * */
+#define DECLARE_VECTOR(type, name) std::vector<type> name;
+    HIERARCHY_ARRAYS(DECLARE_VECTOR)
+#undef DECLARE_VECTOR
+
+    bool empty() const {
+        return rank.empty();
+    }
+
+    size_t memory() const {
+        /**
+         * Bytes held by the arrays.
+         * */
+#define ARRAY_BYTES(type, name) + name.capacity() * sizeof(type)
+        return 0 HIERARCHY_ARRAYS(ARRAY_BYTES);
+#undef ARRAY_BYTES
+    }
+
+    void clear() {
+#define CLEAR_VECTOR(type, name) std::vector<type>().swap(name);
+        HIERARCHY_ARRAYS(CLEAR_VECTOR)
+#undef CLEAR_VECTOR
+    }
+
+    void build(
+            const int &num_node,
+            const int &num_arc,
+            const int *arc_from,
+            const int *arc_node,
+            const long long *arc_weight
+            );
+
+    bool valid(const int &num_node, const int &num_arc) const {
+        /**
+         * Whether the arrays describe a hierarchy of a graph of num_node
+         * nodes and num_arc arcs, as read back from a file.
+         * */
+        int num_edge = edge_first.size();
+        if((int) rank.size() != num_node
+                || (int) up_begin.size() != num_node + 1
+                || (int) down_begin.size() != num_node + 1
+                || up_begin[0] != 0 || down_begin[0] != 0
+                || up_begin[num_node] != (int) up.size()
+                || down_begin[num_node] != (int) down.size()
+                || (int) edge_second.size() != num_edge)
+            return false;
+        std::vector<bool> seen(num_node, false);
+        for(int x = 0; x < num_node; ++x) {
+            if(rank[x] < 0 || rank[x] >= num_node || seen[rank[x]]) return false;
+            seen[rank[x]] = true;
+            if(up_begin[x] > up_begin[x + 1] || down_begin[x] > down_begin[x + 1])
+                return false;
+        }
+        for(int d = 0; d < 2; ++d) {
+            const std::vector<HierarchyArc> &list = d ? down : up;
+            for(size_t i = 0; i < list.size(); ++i)
+                if(list[i].node < 0 || list[i].node >= num_node
+                        || list[i].edge < 0 || list[i].edge >= num_edge
+                        || list[i].weight < 0)
+                    return false;
+        }
+        for(int e = 0; e < num_edge; ++e)
+            if(edge_second[e] == -1 ?
+                    edge_first[e] < 0 || edge_first[e] >= num_arc :
+                    edge_first[e] < 0 || edge_first[e] >= e
+                    || edge_second[e] < 0 || edge_second[e] >= e)
+                return false;
+        return true;
+    }
+
+    int search(
+            const int &source_begin,
+            const int &source_end,
+            const int &target_begin,
+            const int &target_end,
+            HierarchyWorkspace &workspace,
+            long long &best
+            ) const {
+        /**
+         * Shortest route from any node of [source_begin, source_end) to any
+         * node of [target_begin, target_end), searching upward from both
+         * sides. A node is not expanded while a higher ranked node reaches
+         * it more cheaply from the same side (stall-on-demand).
+         * Return the position where the two halves meet and set best to the
+         * weight of the route, or return -1 if there is none.
+         * */
+        int num_node = rank.size();
+        std::greater<std::pair<long long, int> > heap_cmp;
+        for(int d = 0; d < 2; ++d) {
+            if((int) workspace.key[d].size() != num_node) {
+                workspace.key[d].assign(num_node, LLONG_MAX);
+                workspace.parent[d].assign(num_node, -1);
+                workspace.pre[d].assign(num_node, -1);
+                workspace.touched.clear();
+            }
+            workspace.heap[d].clear();
+        }
+        for(size_t i = 0; i < workspace.touched.size(); ++i) {
+            int x = workspace.touched[i];
+            workspace.key[0][x] = workspace.key[1][x] = LLONG_MAX;
+            workspace.parent[0][x] = workspace.parent[1][x] = -1;
+        }
+        workspace.touched.clear();
+
+        best = LLONG_MAX;
+        int meet = -1;
+        for(int d = 0; d < 2; ++d)
+            for(int v = d ? target_begin : source_begin; v < (d ? target_end : source_end); ++v) {
+                int x = rank[v];
+                if(workspace.key[1 - d][x] == LLONG_MAX) workspace.touched.push_back(x);
+                else best = 0, meet = x;
+                workspace.key[d][x] = 0;
+                workspace.heap[d].push_back(std::make_pair(0LL, x));
+                ++workspace.pushed;
+            }
+
+        while(true) {
+            int d = workspace.heap[0].empty() ? 1 : workspace.heap[1].empty() ? 0 :
+                workspace.heap[0].front().first <= workspace.heap[1].front().first ? 0 : 1;
+            std::vector<std::pair<long long, int> > &heap = workspace.heap[d];
+            if(heap.empty() || heap.front().first >= best) break;
+            long long now = heap.front().first;
+            int x = heap.front().second;
+            std::pop_heap(heap.begin(), heap.end(), heap_cmp);
+            heap.pop_back();
+            std::vector<long long> &key = workspace.key[d];
+            if(now > key[x]) continue;
+
+            const std::vector<int> &stall_begin = d ? up_begin : down_begin;
+            const std::vector<HierarchyArc> &stall = d ? up : down;
+            bool stalled = false;
+            for(int i = stall_begin[x]; i < stall_begin[x + 1] && !stalled; ++i)
+                stalled = key[stall[i].node] != LLONG_MAX &&
+                    key[stall[i].node] + stall[i].weight < now;
+            if(stalled) continue;
+            ++workspace.settled;
+
+            const std::vector<int> &begin = d ? down_begin : up_begin;
+            const std::vector<HierarchyArc> &list = d ? down : up;
+            for(int i = begin[x]; i < begin[x + 1]; ++i) {
+                int y = list[i].node;
+                long long next = now + list[i].weight;
+                ++workspace.relaxed;
+                if(next >= key[y] || next >= best) continue;
+                if(key[y] != LLONG_MAX) ++workspace.repushed;
+                ++workspace.pushed;
+                if(workspace.key[0][y] == LLONG_MAX && workspace.key[1][y] == LLONG_MAX)
+                    workspace.touched.push_back(y);
+                key[y] = next;
+                workspace.parent[d][y] = x, workspace.pre[d][y] = list[i].edge;
+                heap.push_back(std::make_pair(next, y));
+                std::push_heap(heap.begin(), heap.end(), heap_cmp);
+                long long other = workspace.key[1 - d][y];
+                if(other != LLONG_MAX && next + other < best)
+                    best = next + other, meet = y;
+            }
+        }
+        return meet;
+    }
+
+    void unpack(const int &e, std::vector<int> &arcs) const {
+        /**
+         * Append the original arcs edge e stands for, in route order.
+         * */
+        if(edge_second[e] == -1) {
+            arcs.push_back(edge_first[e]);
+            return;
+        }
+        unpack(edge_first[e], arcs);
+        unpack(edge_second[e], arcs);
+    }
+
+    void unpack_route(
+            const int &meet,
+            HierarchyWorkspace &workspace,
+            std::vector<int> &arcs
+            ) const {
+        /**
+         * The original arcs of the route search found through meet.
+         * */
+        arcs.clear();
+        std::vector<int> &climb = workspace.climb;
+        climb.clear();
+        for(int x = meet; workspace.parent[0][x] != -1; x = workspace.parent[0][x])
+            climb.push_back(workspace.pre[0][x]);
+        for(int i = climb.size() - 1; i >= 0; --i)
+            unpack(climb[i], arcs);
+        for(int x = meet; workspace.parent[1][x] != -1; x = workspace.parent[1][x])
+            unpack(workspace.pre[1][x], arcs);
+    }
+};
+
+class HierarchyBuilder {
+    /**
+     * The state of contracting a graph into a ContractionHierarchy.
+     * Out, In: Edges between nodes not contracted yet, as (other node,
+     *          edge), at most one per ordered pair of nodes.
+     * Weight: Weight of every edge added, shortcuts included.
+     * Deleted: Neighbours of each node contracted so far.
+     * Level: One more than the highest level of the neighbours of each
+     *        node contracted so far, 0 if none.
+     * Dist, Hop, Reached: Labels of the witness search, the edges it took
+     *                     to each and the nodes it set.
+     * Target, Bound, Open: The nodes a witness search looks for are those
+     *                      whose target is the current stamp, each needing
+     *                      a route no heavier than its bound. Open lists
+     *                      them as (bound, node), the heaviest first.
+     * Pending: Shortcuts the last node looked at needs, see shortcuts.
+     * */
+private :
+    ContractionHierarchy &ch;
+    std::vector<std::vector<std::pair<int, int> > > out, in;
+    std::vector<long long> weight;
+    std::vector<int> deleted, level;
+    std::vector<long long> dist, bound;
+    std::vector<int> hop, reached, target;
+    std::vector<std::pair<long long, int> > heap, open;
+    int stamp;
+    std::vector<std::pair<std::pair<int, int>, std::pair<long long, std::pair<int, int> > > > pending;
+
+    int add_edge(const long long &edge_weight, const int &first, const int &second) {
+        weight.push_back(edge_weight);
+        ch.edge_first.push_back(first), ch.edge_second.push_back(second);
+        return weight.size() - 1;
+    }
+
+    void link(const int &from, const int &to, const long long &edge_weight,
+            const int &first, const int &second) {
+        /**
+         * Add an edge from node from to node to, or make the one there is
+         * cheaper.
+         * */
+        for(size_t i = 0; i < out[from].size(); ++i) {
+            if(out[from][i].first != to) continue;
+            if(weight[out[from][i].second] <= edge_weight) return;
+            int e = add_edge(edge_weight, first, second);
+            out[from][i].second = e;
+            for(size_t j = 0; j < in[to].size(); ++j)
+                if(in[to][j].first == from) in[to][j].second = e;
+            return;
+        }
+        int e = add_edge(edge_weight, first, second);
+        out[from].push_back(std::make_pair(to, e));
+        in[to].push_back(std::make_pair(from, e));
+    }
+
+    void witness(const int &source, const int &skip) {
+        /**
+         * Search from source without passing skip for the targets in open.
+         * A target reached within its bound is witnessed and its target
+         * set to -1. The search stops once every target is witnessed or
+         * settled, or HIERARCHY_WITNESS_LIMIT nodes are settled, and goes
+         * at most HIERARCHY_WITNESS_HOPS edges deep.
+         * */
+        std::greater<std::pair<long long, int> > heap_cmp;
+        for(size_t i = 0; i < reached.size(); ++i)
+            dist[reached[i]] = LLONG_MAX;
+        reached.clear(), heap.clear();
+        dist[source] = 0, hop[source] = 0, reached.push_back(source);
+        heap.push_back(std::make_pair(0LL, source));
+        size_t first = 0;
+        for(int settled = 0; !heap.empty() && settled < HIERARCHY_WITNESS_LIMIT; ) {
+            long long now = heap.front().first;
+            int x = heap.front().second;
+            std::pop_heap(heap.begin(), heap.end(), heap_cmp);
+            heap.pop_back();
+            if(now > dist[x]) continue;
+            while(first < open.size() && target[open[first].second] != stamp) ++first;
+            if(first == open.size() || now > open[first].first) break;
+            ++settled;
+            if(target[x] == stamp) target[x] = ~stamp;
+            if(hop[x] == HIERARCHY_WITNESS_HOPS) continue;
+            for(size_t i = 0; i < out[x].size(); ++i) {
+                int y = out[x][i].first;
+                if(y == skip) continue;
+                long long next = now + weight[out[x][i].second];
+                if(next >= dist[y]) continue;
+                if(dist[y] == LLONG_MAX) reached.push_back(y);
+                dist[y] = next, hop[y] = hop[x] + 1;
+                if(target[y] == stamp && next <= bound[y]) target[y] = -1;
+                heap.push_back(std::make_pair(next, y));
+                std::push_heap(heap.begin(), heap.end(), heap_cmp);
+            }
+        }
+    }
+
+    int shortcuts(const int &v) {
+        /**
+         * Find the shortcuts contracting v needs, as (from, to) and
+         * (weight, (first edge, second edge)) in pending, and count them.
+         * */
+        pending.clear();
+        for(size_t i = 0; i < in[v].size(); ++i) {
+            int u = in[v][i].first;
+            long long first = weight[in[v][i].second];
+            ++stamp;
+            open.clear();
+            for(size_t j = 0; j < out[v].size(); ++j) {
+                int w = out[v][j].first;
+                if(w == u) continue;
+                target[w] = stamp, bound[w] = first + weight[out[v][j].second];
+                open.push_back(std::make_pair(bound[w], w));
+            }
+            if(open.empty()) continue;
+            std::sort(open.begin(), open.end(), std::greater<std::pair<long long, int> >());
+            witness(u, v);
+            for(size_t j = 0; j < out[v].size(); ++j) {
+                int w = out[v][j].first;
+                if(w == u || target[w] == -1) continue;
+                pending.push_back(std::make_pair(std::make_pair(u, w), std::make_pair(bound[w],
+                                std::make_pair(in[v][i].second, out[v][j].second))));
+            }
+        }
+        return pending.size();
+    }
+
+    int priority(const int &v) {
+        /**
+         * Edge difference of contracting v, shortcuts counted twice, plus
+         * its contracted neighbours so that contraction spreads evenly over
+         * the graph, plus its level so that the hierarchy stays shallow.
+         * */
+        return 2 * shortcuts(v) - (int) (in[v].size() + out[v].size()) + deleted[v] + level[v];
+    }
+
+public :
+    HierarchyBuilder(ContractionHierarchy &ch) : ch(ch) {}
+
+    void run(
+            const int &num_node,
+            const int &num_arc,
+            const int *arc_from,
+            const int *arc_node,
+            const long long *arc_weight
+            ) {
+        ch.clear();
+        weight.clear();
+        out.assign(num_node, std::vector<std::pair<int, int> >());
+        in.assign(num_node, std::vector<std::pair<int, int> >());
+        deleted.assign(num_node, 0), level.assign(num_node, 0);
+        dist.assign(num_node, LLONG_MAX), bound.assign(num_node, 0);
+        hop.assign(num_node, 0), target.assign(num_node, -1);
+        reached.clear();
+        stamp = 0;
+        for(int a = 0; a < num_arc; ++a)
+            if(arc_from[a] != arc_node[a])
+                link(arc_from[a], arc_node[a], arc_weight[a], a, -1);
+
+        std::vector<std::vector<int> > up(num_node), down(num_node);
+        std::vector<std::vector<int> > up_node(num_node), down_node(num_node);
+        std::vector<std::pair<int, int> > queue;
+        std::greater<std::pair<int, int> > queue_cmp;
+        for(int x = 0; x < num_node; ++x)
+            queue.push_back(std::make_pair(priority(x), x));
+        std::make_heap(queue.begin(), queue.end(), queue_cmp);
+        ch.rank.assign(num_node, -1);
+        for(int order = 0; !queue.empty(); ) {
+            int v = queue.front().second;
+            std::pop_heap(queue.begin(), queue.end(), queue_cmp);
+            queue.pop_back();
+            int now = priority(v);
+            if(!queue.empty() && now > queue.front().first) {
+                queue.push_back(std::make_pair(now, v));
+                std::push_heap(queue.begin(), queue.end(), queue_cmp);
+                continue;
+            }
+
+            for(size_t i = 0; i < pending.size(); ++i)
+                link(pending[i].first.first, pending[i].first.second, pending[i].second.first,
+                        pending[i].second.second.first, pending[i].second.second.second);
+            ch.rank[v] = order++;
+            for(size_t i = 0; i < out[v].size(); ++i) {
+                int w = out[v][i].first;
+                up[v].push_back(out[v][i].second), up_node[v].push_back(w);
+                for(size_t j = 0; j < in[w].size(); ++j)
+                    if(in[w][j].first == v) {
+                        in[w].erase(in[w].begin() + j);
+                        break;
+                    }
+                ++deleted[w], level[w] = std::max(level[w], level[v] + 1);
+            }
+            for(size_t i = 0; i < in[v].size(); ++i) {
+                int u = in[v][i].first;
+                down[v].push_back(in[v][i].second), down_node[v].push_back(u);
+                for(size_t j = 0; j < out[u].size(); ++j)
+                    if(out[u][j].first == v) {
+                        out[u].erase(out[u].begin() + j);
+                        break;
+                    }
+                ++deleted[u], level[u] = std::max(level[u], level[v] + 1);
+            }
+            std::vector<std::pair<int, int> >().swap(out[v]);
+            std::vector<std::pair<int, int> >().swap(in[v]);
+        }
+
+        /**
+         * Keep only the edges the hierarchy uses, directly or inside a
+         * shortcut. Parts of a shortcut were added before it, so walking
+         * the edges backward marks them all and keeps them in order.
+         * */
+        int num_edge = weight.size();
+        std::vector<int> index(num_edge, -1);
+        for(int x = 0; x < num_node; ++x) {
+            for(size_t i = 0; i < up[x].size(); ++i) index[up[x][i]] = 0;
+            for(size_t i = 0; i < down[x].size(); ++i) index[down[x][i]] = 0;
+        }
+        for(int e = num_edge - 1; e >= 0; --e)
+            if(index[e] == 0 && ch.edge_second[e] != -1)
+                index[ch.edge_first[e]] = index[ch.edge_second[e]] = 0;
+        int kept = 0;
+        for(int e = 0; e < num_edge; ++e) {
+            if(index[e] == -1) continue;
+            index[e] = kept;
+            bool shortcut = ch.edge_second[e] != -1;
+            ch.edge_first[kept] = shortcut ? index[ch.edge_first[e]] : ch.edge_first[e];
+            ch.edge_second[kept] = shortcut ? index[ch.edge_second[e]] : -1;
+            ++kept;
+        }
+        ch.edge_first.resize(kept), ch.edge_second.resize(kept);
+
+        std::vector<int> node_at(num_node);
+        for(int x = 0; x < num_node; ++x)
+            node_at[ch.rank[x]] = x;
+        ch.up_begin.assign(1, 0), ch.down_begin.assign(1, 0);
+        for(int p = 0; p < num_node; ++p) {
+            int x = node_at[p];
+            for(size_t i = 0; i < up[x].size(); ++i) {
+                HierarchyArc arc;
+                arc.weight = weight[up[x][i]];
+                arc.node = ch.rank[up_node[x][i]], arc.edge = index[up[x][i]];
+                ch.up.push_back(arc);
+            }
+            for(size_t i = 0; i < down[x].size(); ++i) {
+                HierarchyArc arc;
+                arc.weight = weight[down[x][i]];
+                arc.node = ch.rank[down_node[x][i]], arc.edge = index[down[x][i]];
+                ch.down.push_back(arc);
+            }
+            ch.up_begin.push_back(ch.up.size());
+            ch.down_begin.push_back(ch.down.size());
+        }
+    }
+};
+
+void ContractionHierarchy::build(
+        const int &num_node,
+        const int &num_arc,
+        const int *arc_from,
+        const int *arc_node,
+        const long long *arc_weight
+        ) {
+    /**
+     * Contract the graph of num_node nodes whose arc a goes from
+     * arc_from[a] to arc_node[a] with weight arc_weight[a] >= 0.
+     * */
+    HierarchyBuilder builder(*this);
+    builder.run(num_node, num_arc, arc_from, arc_node, arc_weight);
+}
+
+bool write_hierarchy(
+        const std::string &filename,
+        const std::vector<ContractionHierarchy> &list,
+        const unsigned long long &fingerprint
+        ) {
+    /**
+     * Write the hierarchies of list to filename, in the snapshot layout:
+     * a SnapshotHeader, one SnapshotSection per array, then the arrays.
+     * The first array holds fingerprint, which identifies the graph the
+     * hierarchies were built from.
+     * Return false if the file cannot be written.
+     * */
+    int num_array = 1 + list.size() * NUM_HIERARCHY_ARRAY;
+    std::vector<SnapshotSection> sections(num_array);
+    std::vector<std::pair<const char *, size_t> > source(num_array);
+    unsigned long long offset = sizeof(SnapshotHeader)
+        + sizeof(SnapshotSection) * num_array;
+    int k = 0;
+#define ADD_SECTION(type, begin, length) { \
+        offset = (offset + 7) / 8 * 8; \
+        sections[k].offset = offset; \
+        sections[k].count = length; \
+        sections[k].element_size = sizeof(type); \
+        source[k] = std::make_pair((const char *) (begin), (length) * sizeof(type)); \
+        offset += (length) * sizeof(type); \
+        ++k; \
+    }
+    ADD_SECTION(unsigned long long, &fingerprint, 1);
+    for(size_t i = 0; i < list.size(); ++i) {
+#define ADD_ARRAY(type, name) \
+        ADD_SECTION(type, list[i].name.empty() ? NULL : &list[i].name[0], \
+                list[i].name.size())
+        HIERARCHY_ARRAYS(ADD_ARRAY)
+#undef ADD_ARRAY
+    }
+#undef ADD_SECTION
+
+    std::vector<char> file(offset, 0);
+    memcpy(&file[sizeof(SnapshotHeader)], &sections[0],
+            sizeof(SnapshotSection) * num_array);
+    for(int i = 0; i < num_array; ++i)
+        if(source[i].second > 0)
+            memcpy(&file[sections[i].offset], source[i].first, source[i].second);
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HIERARCHY_MAGIC, 8);
+    header.version = HIERARCHY_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.num_array = num_array;
+    header.size = offset;
+    header.checksum = snapshot_checksum(
+            &file[sizeof(SnapshotHeader)], offset - sizeof(SnapshotHeader)
+        );
+    memcpy(&file[0], &header, sizeof(header));
+
+    /**
+     * Write a new file and rename it over filename, so that a process
+     * loading it meanwhile never reads half a file.
+     * */
+    std::string temp = filename + ".tmp";
+    FILE *out = fopen(temp.c_str(), "wb");
+    if(out == NULL) return false;
+    bool ok = fwrite(&file[0], 1, file.size(), out) == file.size();
+    ok = fclose(out) == 0 && ok;
+    #ifdef WIN32
+    if(ok) remove(filename.c_str());
+    #endif
+    ok = ok && rename(temp.c_str(), filename.c_str()) == 0;
+    if(!ok) remove(temp.c_str());
+    return ok;
+}
+
+bool read_hierarchy(
+        const std::string &filename,
+        std::vector<ContractionHierarchy> &list,
+        const unsigned long long &fingerprint
+        ) {
+    /**
+     * Read list.size() hierarchies written by write_hierarchy into list.
+     * Return false if the file is missing, damaged, holds a different
+     * number of hierarchies or was built from another graph.
+     * */
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if(!in) return false;
+    std::vector<char> file((std::istreambuf_iterator<char>(in)),
+            std::istreambuf_iterator<char>());
+    size_t num_array = 1 + list.size() * NUM_HIERARCHY_ARRAY;
+    size_t table_end = sizeof(SnapshotHeader) + sizeof(SnapshotSection) * num_array;
+    if(file.size() < table_end) return false;
+    SnapshotHeader header;
+    memcpy(&header, &file[0], sizeof(header));
+    if(memcmp(header.magic, HIERARCHY_MAGIC, 8) != 0
+            || header.version != HIERARCHY_VERSION
+            || header.byte_order != SNAPSHOT_BYTE_ORDER
+            || header.num_array != num_array
+            || header.size != file.size()
+            || header.checksum != snapshot_checksum(
+                &file[sizeof(SnapshotHeader)], file.size() - sizeof(SnapshotHeader)
+                ))
+        return false;
+
+    std::vector<SnapshotSection> sections(num_array);
+    memcpy(&sections[0], &file[sizeof(SnapshotHeader)],
+            sizeof(SnapshotSection) * num_array);
+    bool ok = true;
+    int k = 0;
+#define GET_SECTION(type, target) { \
+        const SnapshotSection &section = sections[k++]; \
+        ok = ok && section.element_size == sizeof(type) \
+            && section.offset <= file.size() \
+            && section.count <= (file.size() - section.offset) / sizeof(type) \
+            && section.count <= 0x7fffffffULL; \
+        if(ok) { \
+            target.resize(section.count); \
+            if(section.count > 0) \
+                memcpy(&target[0], &file[section.offset], section.count * sizeof(type)); \
+        } \
+    }
+    std::vector<unsigned long long> stored;
+    GET_SECTION(unsigned long long, stored);
+    if(!ok || stored.size() != 1 || stored[0] != fingerprint) return false;
+    for(size_t i = 0; i < list.size(); ++i) {
+#define GET_ARRAY(type, name) GET_SECTION(type, list[i].name)
+        HIERARCHY_ARRAYS(GET_ARRAY)
+#undef GET_ARRAY
+    }
+#undef GET_SECTION
+    return ok;
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "metro.cpp"
@@ -7,6 +8,7 @@
 #ifdef WIN32
 #include <Windows.h>
 #else
+#include <signal.h>
 #include <unistd.h>
 #endif
 
@@ -97,8 +99,53 @@ void action1(Metro * metro)
     enterConfirm();
 }
 
+#define MATCH_LIMIT (10)
+/**
+ * Most stations a name lookup answers with.
+ * */
+
+int searchStation(const char msg[], Metro * metro)
+{
+    /**
+     * Let the user type part of a station name and pick one of the
+     * stations found. Return 0 to choose by line instead.
+     * */
+    header();
+    puts(msg);
+    bigLine();
+    printf("  Type a station name, or ENTER to choose by line: ");
+    char line[256];
+    if (fgets(line, sizeof(line), stdin) == NULL)
+        return 0;
+    string text = line;
+    text.erase(0, text.find_first_not_of(" \t\r\n"));
+    text.erase(text.find_last_not_of(" \t\r\n") + 1);
+    if (text.empty())
+        return 0;
+    vector<StationMatch> matches;
+    if (metro->match_station(text, MATCH_LIMIT, matches) == 0)
+        return -1;
+    smallLine();
+    for (size_t i = 0; i < matches.size(); ++i)
+        printf("  %zu. %s\n", i + 1, string(metro->station_name(matches[i].station)).c_str());
+    printf("  0. Choose by line\n");
+    smallLine();
+    int station;
+    while (true) {
+        printf("  Choose a station: ");
+        station = getInt();
+        if (0 <= station && station <= (int)matches.size())
+            break;
+        printf("\n  Invalid input!\n\n");
+    }
+    return station == 0 ? 0 : matches[station - 1].station;
+}
+
 int pickStation(const char msg[], Metro * metro)
 {
+    int found = searchStation(msg, metro);
+    if (found != 0)
+        return found;
     header();
     puts(msg);
     bigLine();
@@ -143,11 +190,10 @@ int pickStation(const char msg[], Metro * metro)
 
 void printQueryResult(const Response &response, int query_type)
 {
-    vector< pair<string, vector<string> > > path = response.path;
+    const vector< pair<string, vector<string> > > &path = response.path;
     int money = response.money;
     int cost_time = response.cost_time;
     double distance = response.distance;
-    vector<int> time_between_station = response.time_between_station;
 
     header();
     printf("  Query Result\n");
@@ -164,8 +210,8 @@ void printQueryResult(const Response &response, int query_type)
     printf("%.40s %s\n", msg, (query_type == 3 ? "[Min]" : ""));
     smallLine();
     for (size_t i = 0; i < path.size(); ++i) {
-        string& line = path[i].first;
-        vector<string>& stations = path[i].second;
+        const string &line = path[i].first;
+        const vector<string> &stations = path[i].second;
         if (i == 0)
             printf("  Depart from %s, Line %s\n", stations[0].c_str(), line.c_str());
         else
@@ -178,6 +224,35 @@ void printQueryResult(const Response &response, int query_type)
     enterConfirm();
 }
 
+bool pickTradeOff(const string &src, const string &dest, const vector<Response> &routes, Response &picked)
+{
+    /**
+     * List the routes no other route beats on time, fee and interchanges
+     * at once, and let the user pick one of them.
+     * */
+    if (routes.empty())
+        return false;
+    header();
+    printf("  Departure: %s\n", src.c_str());
+    printf("  Arrival:   %s\n", dest.c_str());
+    smallLine();
+    for (size_t i = 0; i < routes.size(); ++i)
+        printf("  %zu. %4d minute  %3d RMB  %2zu interchange  %6.2lf km\n", i + 1,
+                routes[i].cost_time, routes[i].money, routes[i].path.size() - 1,
+                routes[i].distance);
+    smallLine();
+    int choice;
+    while (true) {
+        printf("  Choose a route: ");
+        choice = getInt();
+        if (0 < choice && choice <= (int)routes.size())
+            break;
+        printf("\n  Invalid input!\n\n");
+    }
+    picked = routes[choice - 1];
+    return true;
+}
+
 void subMenu2(Metro * metro)
 {
     int src_ind, dest_ind;
@@ -206,6 +281,7 @@ void subMenu2(Metro * metro)
         printf("  1. Query minimum time\n");
         printf("  2. Query minimum distance\n");
         printf("  3. Query minimum ticket fee\n");
+        printf("  4. Compare all trade-offs\n");
         smallLine();
         printf("  Your choice:  ");
         switch (query_type = getInt()) {
@@ -218,6 +294,14 @@ void subMenu2(Metro * metro)
             case 3:
                 response = metro->query_money(src_ind, dest_ind);
                 break;
+            case 4:
+                if (!pickTradeOff(src, dest, metro->query_pareto(src_ind, dest_ind), response)) {
+                    printf("\n  Unable to find such route!\n");
+                    milliSleep(750);
+                    continue;
+                }
+                query_type = 0;
+                break;
             default:
                 printf("\n  Invalid input!\n");
                 milliSleep(750);
@@ -261,9 +345,536 @@ void exitMessage()
     milliSleep(1000);
 }
 
-int main()
+/**
+ * Batch mode: no menu and no screen clearing. Every input line is a query
+ * "start end [criterion]", where a station is given by index or name and the
+ * criterion defaults to Time. A departure time HH:MM in place of the
+ * criterion asks for the earliest arrival by the timetables instead.
+ * Every query gets exactly one output line, in
+ * input order, as a JSON object or as tab separated fields.
+ * */
+
+#define BATCH_CHUNK (4096)
+#define BATCH_BUFFER (1 << 20)
+
+struct BatchQuery
+{
+    int start, end, criterion, departure;
+    const char * error;
+};
+
+int parseStation(const string &token, const Metro * metro)
+{
+    if (token.find_first_not_of("0123456789") != string::npos)
+        return metro->query_station_index(token);
+    int index = atoi(token.c_str());
+    return metro->query_station_name(index).empty() ? -1 : index;
+}
+
+BatchQuery parseQuery(const string &line, const Metro * metro)
+{
+    BatchQuery query;
+    query.start = query.end = -1;
+    query.criterion = CRITERION_TIME;
+    query.departure = -1;
+    query.error = NULL;
+    string token[4];
+    int n = 0;
+    const char * space = " \t\r\n";
+    size_t begin = line.find_first_not_of(space);
+    while (begin != string::npos && n < 4) {
+        size_t end = line.find_first_of(space, begin);
+        token[n++] = line.substr(begin, end == string::npos ? string::npos : end - begin);
+        begin = line.find_first_not_of(space, end);
+    }
+    if (n < 2 || n > 3 || begin != string::npos) {
+        query.error = "expected: start end [criterion]";
+        return query;
+    }
+    if ((query.start = parseStation(token[0], metro)) == -1)
+        query.error = "unknown start station";
+    else if ((query.end = parseStation(token[1], metro)) == -1)
+        query.error = "unknown end station";
+    else if (n == 3 && token[2].find(':') != string::npos) {
+        if ((query.departure = parse_clock(token[2])) == -1)
+            query.error = "unknown departure time";
+    }
+    else if (n == 3) {
+        query.criterion = -1;
+        for (int i = 0; i < NUM_CRITERION; ++i)
+            if (strcasecmp(token[2].c_str(), CRITERION_NAME[i]) == 0)
+                query.criterion = i;
+        if (query.criterion == -1)
+            query.error = "unknown criterion";
+    }
+    return query;
+}
+
+void appendJsonString(string &out, string_view s)
+{
+    out += '"';
+    size_t done = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = s[i];
+        if (c != '"' && c != '\\' && c >= 0x20)
+            continue;
+        out.append(s.data() + done, i - done);
+        char escaped[8];
+        if (c < 0x20)
+            sprintf(escaped, "\\u%04x", c);
+        else
+            sprintf(escaped, "\\%c", c);
+        out += escaped;
+        done = i + 1;
+    }
+    out.append(s.data() + done, s.size() - done);
+    out += '"';
+}
+
+string clockText(int minute)
+{
+    char res[16];
+    sprintf(res, "%02d:%02d", minute / 60, minute % 60);
+    return res;
+}
+
+void formatJson(const BatchQuery &query, const Route &route, const Metro * metro, string &out)
+{
+    if (query.error != NULL) {
+        out += "{\"error\":";
+        appendJsonString(out, query.error);
+        out += "}\n";
+        return;
+    }
+    out += "{\"start\":";
+    appendJsonString(out, metro->station_name(query.start));
+    out += ",\"end\":";
+    appendJsonString(out, metro->station_name(query.end));
+    char msg[100];
+    if (query.departure != -1) {
+        sprintf(msg, ",\"departure\":\"%s", clockText(query.departure).c_str());
+        out += msg;
+        if (route.cost_time < INF) {
+            sprintf(msg, "\",\"arrival\":\"%s",
+                    clockText(query.departure + route.cost_time).c_str());
+            out += msg;
+        }
+    }
+    else {
+        out += ",\"criterion\":\"";
+        out += CRITERION_NAME[query.criterion];
+    }
+    if (route.cost_time >= INF) {
+        out += "\",\"reachable\":false}\n";
+        return;
+    }
+    sprintf(msg, "\",\"time\":%d,\"money\":%d,\"distance\":%.2lf,\"path\":[",
+            route.cost_time, route.money, route.distance);
+    out += msg;
+    for (int i = 0; i < route.num_segment(); ++i) {
+        out += i ? ",{\"line\":" : "{\"line\":";
+        appendJsonString(out, metro->line_name(route.segment_line[i]));
+        out += ",\"stations\":[";
+        for (int j = route.segment_begin[i]; j < route.segment_begin[i + 1]; ++j) {
+            if (j > route.segment_begin[i])
+                out += ',';
+            appendJsonString(out, metro->station_name(route.station[j]));
+        }
+        out += "]}";
+    }
+    out += "]}\n";
+}
+
+void formatTsv(const BatchQuery &query, const Route &route, const Metro * metro, string &out)
+{
+    /**
+     * start, end, criterion or departure, time, money, distance, path; the path is
+     * "line:station,station,..." per segment, joined by '|'.
+     * An error line is "error" followed by the message.
+     * */
+    if (query.error != NULL) {
+        out += "error\t";
+        out += query.error;
+        out += '\n';
+        return;
+    }
+    out += metro->station_name(query.start);
+    out += '\t';
+    out += metro->station_name(query.end);
+    out += '\t';
+    out += query.departure != -1 ? clockText(query.departure) : CRITERION_NAME[query.criterion];
+    if (route.cost_time >= INF) {
+        out += "\t-\t-\t-\t-\n";
+        return;
+    }
+    char msg[100];
+    sprintf(msg, "\t%d\t%d\t%.2lf\t", route.cost_time, route.money, route.distance);
+    out += msg;
+    for (int i = 0; i < route.num_segment(); ++i) {
+        if (i)
+            out += '|';
+        out += metro->line_name(route.segment_line[i]);
+        for (int j = route.segment_begin[i]; j < route.segment_begin[i + 1]; ++j) {
+            out += j > route.segment_begin[i] ? ',' : ':';
+            out += metro->station_name(route.station[j]);
+        }
+    }
+    out += '\n';
+}
+
+bool parseMatch(const string &line, string &text)
+{
+    /**
+     * A name lookup is "?" followed by the name as typed so far. Set text
+     * to it without the surrounding spaces.
+     * */
+    const char * space = " \t\r\n";
+    size_t begin = line.find_first_not_of(space);
+    if (begin == string::npos || line[begin] != '?')
+        return false;
+    begin = line.find_first_not_of(space, begin + 1);
+    size_t end = line.find_last_not_of(space);
+    text = begin == string::npos ? "" : line.substr(begin, end + 1 - begin);
+    return true;
+}
+
+void formatMatch(const string &text, const vector<StationMatch> &matches, const Metro * metro, bool tsv, string &out)
+{
+    /**
+     * As JSON, {"match": text, "stations": [{"id", "name", "typos"}, ...]}.
+     * As TSV, "match", text and then one "id:name" field per station.
+     * */
+    char msg[64];
+    if (tsv) {
+        out += "match\t";
+        out += text;
+        for (size_t i = 0; i < matches.size(); ++i) {
+            sprintf(msg, "\t%d:", matches[i].station);
+            out += msg;
+            out += metro->station_name(matches[i].station);
+        }
+        out += '\n';
+        return;
+    }
+    out += "{\"match\":";
+    appendJsonString(out, text);
+    out += ",\"stations\":[";
+    for (size_t i = 0; i < matches.size(); ++i) {
+        sprintf(msg, "%s{\"id\":%d,\"name\":", i ? "," : "", matches[i].station);
+        out += msg;
+        appendJsonString(out, metro->station_name(matches[i].station));
+        sprintf(msg, ",\"typos\":%d}", matches[i].distance);
+        out += msg;
+    }
+    out += "]}\n";
+}
+
+void runBatch(const Metro * metro, FILE * in, FILE * out, bool tsv)
+{
+    /**
+     * Queries are read in chunks. Each chunk is answered by query_batch,
+     * one call per criterion, and then written out in input order.
+     * */
+    vector<char> in_buffer(BATCH_BUFFER), out_buffer(BATCH_BUFFER);
+    setvbuf(in, &in_buffer[0], _IOFBF, BATCH_BUFFER);
+    setvbuf(out, &out_buffer[0], _IOFBF, BATCH_BUFFER);
+
+    char line[1024];
+    vector<BatchQuery> queries;
+    vector<Route> routes, answers;
+    vector< pair<int, int> > pairs;
+    vector<size_t> position;
+    string text;
+    bool more = true;
+    while (more) {
+        queries.clear();
+        while (queries.size() < BATCH_CHUNK && (more = fgets(line, sizeof(line), in) != NULL)) {
+            if (strchr(line, '\n') == NULL && !feof(in)) {
+                for (int c = getc(in); c != '\n' && c != EOF; c = getc(in))
+                    ;
+                BatchQuery query;
+                query.error = "line too long";
+                queries.push_back(query);
+                continue;
+            }
+            if (strspn(line, " \t\r\n") == strlen(line))
+                continue;
+            queries.push_back(parseQuery(line, metro));
+        }
+
+        routes.resize(queries.size());
+        for (int c = 0; c < NUM_CRITERION; ++c) {
+            pairs.clear(), position.clear();
+            for (size_t i = 0; i < queries.size(); ++i)
+                if (queries[i].error == NULL && queries[i].departure == -1 &&
+                        queries[i].criterion == c) {
+                    pairs.push_back(make_pair(queries[i].start, queries[i].end));
+                    position.push_back(i);
+                }
+            if (pairs.empty())
+                continue;
+            metro->query_batch(pairs, CRITERION_NAME[c], answers);
+            for (size_t i = 0; i < answers.size(); ++i)
+                std::swap(routes[position[i]], answers[i]);
+        }
+        for (size_t i = 0; i < queries.size(); ++i)
+            if (queries[i].error == NULL && queries[i].departure != -1)
+                metro->query_departure(queries[i].start, queries[i].end,
+                        queries[i].departure, routes[i]);
+
+        for (size_t i = 0; i < queries.size(); ++i) {
+            text.clear();
+            if (tsv)
+                formatTsv(queries[i], routes[i], metro, text);
+            else
+                formatJson(queries[i], routes[i], metro, text);
+            fwrite(text.data(), 1, text.size(), out);
+        }
+    }
+    fflush(out);
+}
+
+struct NetworkOptions
+{
+    const char * snapshot;
+    const char * manifest;
+    const char * hierarchy;
+    bool stats;
+};
+
+Metro * loadNetwork(const NetworkOptions &options, const Metro * previous)
+{
+    /**
+     * Load the network the options name and build its indexes, NULL if
+     * it cannot be read. A reload, given the previous network, builds the
+     * hierarchy afresh instead of reading the file, which belongs to the
+     * previous network, and records its stats into the same counters.
+     * */
+    bool reload = previous != NULL;
+    Metro *metro;
+    if (options.snapshot)
+        metro = new Metro(string(options.snapshot));
+    else if (options.manifest) {
+        metro = new Metro(NULL, 0);
+        if (!metro->load_manifest(options.manifest)) {
+            fprintf(stderr, "Unable to read %s\n", options.manifest);
+            delete metro;
+            return NULL;
+        }
+    }
+    else
+        metro = new Metro(Metro::SUBWAY_NAME, 10);
+    if (metro->num_station() == 0) {
+        delete metro;
+        return NULL;
+    }
+    const char * hierarchy = options.hierarchy;
+    if (hierarchy != NULL && (reload || !metro->load_hierarchy(hierarchy))) {
+        metro->precompute_hierarchy();
+        if (!reload && !metro->save_hierarchy(hierarchy))
+            fprintf(stderr, "Unable to write %s\n", hierarchy);
+    }
+    if (!metro->precompute_routes() && hierarchy == NULL)
+        metro->precompute_hierarchy();
+    if (reload)
+        metro->share_stats(*previous);
+    else if (options.stats)
+        metro->enable_stats();
+    return metro;
+}
+
+string networkDirectory(const NetworkOptions &options)
 {
-    Metro *metro = new Metro(Metro::SUBWAY_NAME, 10);
+    /**
+     * The directory whose changes are loaded by --watch: that of the
+     * snapshot or the manifest, data otherwise.
+     * */
+    string path = options.snapshot ? options.snapshot : options.manifest ? options.manifest : "";
+    if (path.empty())
+        return "data";
+    size_t slash = path.rfind('/');
+    return slash == string::npos ? "." : path.substr(0, slash + 1);
+}
+
+bool writeStats(const Metro * metro, const char filename[])
+{
+    /**
+     * Write the stats of metro to filename in the Prometheus text format.
+     * */
+    FILE * out = fopen(filename, "w");
+    if (out == NULL)
+        return false;
+    string text = format_prometheus(metro->stats());
+    fwrite(text.data(), 1, text.size(), out);
+    return fclose(out) == 0;
+}
+
+#ifndef WIN32
+#include "server.cpp"
+#include "reload.cpp"
+
+/**
+ * Server mode: the same queries and answers as batch mode, one per line,
+ * over a socket, so that callers do not pay for a process and a load per
+ * query. A query not started within the deadline is answered with an
+ * error instead. A line "?NAME" looks up the stations whose names start
+ * with NAME, for a client completing names as they are typed.
+ * With --watch, the network is loaded again whenever its directory
+ * changes. The new one is swapped in without stopping: queries already
+ * started finish on the old one, and answering takes no lock. The query
+ * stats carry over to the new network; disruptions do not, since its
+ * stations and sections may differ.
+ * */
+
+QueryServer * server = NULL;
+
+void stopServer(int)
+{
+    if (server != NULL)
+        server->stop();
+}
+
+int runServer(RcuPointer<const Metro> &network, const char address[], int workers, int deadline, bool tsv)
+{
+    QueryServer::Handler handler = [&network, tsv](const string &request, string &reply) {
+        RcuPointer<const Metro>::Guard metro(network);
+        string text;
+        if (parseMatch(request, text)) {
+            static thread_local vector<StationMatch> matches;
+            metro->match_station(text, MATCH_LIMIT, matches);
+            formatMatch(text, matches, metro.get(), tsv, reply);
+            reply.erase(reply.size() - 1);
+            return;
+        }
+        BatchQuery query = parseQuery(request, metro.get());
+        Route route;
+        if (query.error == NULL && query.departure != -1)
+            metro->query_departure(query.start, query.end, query.departure, route);
+        else if (query.error == NULL)
+            metro->query(query.start, query.end, CRITERION_NAME[query.criterion], route);
+        if (tsv)
+            formatTsv(query, route, metro.get(), reply);
+        else
+            formatJson(query, route, metro.get(), reply);
+        reply.erase(reply.size() - 1);
+    };
+    server = new QueryServer(handler,
+            tsv ? "error\tdeadline exceeded" : "{\"error\":\"deadline exceeded\"}",
+            tsv ? "error\tline too long" : "{\"error\":\"line too long\"}",
+            workers, deadline);
+    if (!server->listen(address)) {
+        fprintf(stderr, "Unable to listen on %s: %s\n", address, strerror(errno));
+        delete server;
+        return 1;
+    }
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    fprintf(stderr, "Serving on %s with %d workers\n", address, workers);
+    server->run();
+    delete server;
+    server = NULL;
+    return 0;
+}
+#endif
+
+void usage(const char name[])
+{
+    printf("Usage: %s [--snapshot FILE | --manifest FILE] [--hierarchy FILE] [--batch [FILE] | --serve ADDRESS [--watch]] [--tsv] [--stats FILE]\n", name);
+    printf("  --snapshot FILE  load the network from a snapshot\n");
+    printf("  --manifest FILE  load the lines listed in FILE, from the files next to it\n");
+    printf("  --hierarchy FILE load the contraction hierarchy from FILE, or build and save it there\n");
+    printf("  --batch [FILE]   answer queries from FILE (stdin by default) without the menu\n");
+    printf("  --serve ADDRESS  answer queries on unix:PATH, HOST:PORT or PORT\n");
+    printf("  --watch          load the network again whenever its files change, with --serve\n");
+    printf("  --workers N      worker threads of --serve, one per core by default\n");
+    printf("  --deadline MS    answer queries waiting longer than MS with an error, 1000 by default\n");
+    printf("  --tsv            write results as TSV instead of JSON lines\n");
+    printf("  --stats FILE     record query stats and write them to FILE in Prometheus format on exit\n");
+}
+
+int main(int argc, char **argv)
+{
+    NetworkOptions options = {NULL, NULL, NULL, false};
+    const char * input = NULL;
+    const char * address = NULL;
+    const char * statsFile = NULL;
+    int workers = thread::hardware_concurrency(), deadline = 1000;
+    bool batch = false, tsv = false, watch = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc)
+            options.snapshot = argv[++i];
+        else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc)
+            options.manifest = argv[++i];
+        else if (strcmp(argv[i], "--hierarchy") == 0 && i + 1 < argc)
+            options.hierarchy = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                input = argv[++i];
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            address = argv[++i];
+        else if (strcmp(argv[i], "--watch") == 0)
+            watch = true;
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+            workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--deadline") == 0 && i + 1 < argc)
+            deadline = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tsv") == 0)
+            tsv = true;
+        else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+            statsFile = argv[++i], options.stats = true;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    Metro *metro = loadNetwork(options, NULL);
+    if (metro == NULL) {
+        fprintf(stderr, "Unable to load the network\n");
+        return 1;
+    }
+    if (batch) {
+        FILE * in = input ? fopen(input, "r") : stdin;
+        if (in == NULL) {
+            fprintf(stderr, "Unable to open %s\n", input);
+            return 1;
+        }
+        runBatch(metro, in, stdout, tsv);
+        if (in != stdin)
+            fclose(in);
+        if (statsFile != NULL && !writeStats(metro, statsFile)) {
+            fprintf(stderr, "Unable to write %s\n", statsFile);
+            return 1;
+        }
+        return 0;
+    }
+    if (address != NULL) {
+        #ifdef WIN32
+        fprintf(stderr, "--serve is not supported on Windows\n");
+        return 1;
+        #else
+        RcuPointer<const Metro> network(metro);
+        Reloader<const Metro> reloader(network, [options, &network]() {
+            RcuPointer<const Metro>::Guard previous(network);
+            return loadNetwork(options, previous.get());
+        });
+        if (watch && !reloader.watch(networkDirectory(options))) {
+            fprintf(stderr, "Unable to watch %s: %s\n",
+                    networkDirectory(options).c_str(), strerror(errno));
+            return 1;
+        }
+        int ret = runServer(network, address, workers, deadline, tsv);
+        reloader.stop();
+        RcuPointer<const Metro>::Guard last(network);
+        if (statsFile != NULL && !writeStats(last.get(), statsFile)) {
+            fprintf(stderr, "Unable to write %s\n", statsFile);
+            return 1;
+        }
+        return ret;
+        #endif
+    }
     while (mainMenu(metro))
         ;
     exitMessage();
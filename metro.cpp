@@ -9,22 +9,98 @@
 #include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <climits>
+#include <functional>
+#include <thread>
+#include <string_view>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include "network.cpp"
+#include "route_cache.cpp"
+#include "rcu.cpp"
+#include "stats.cpp"
+#include "thread_pool.cpp"
+#include "timetable.cpp"
+#include "hierarchy.cpp"
+#include "station_index.cpp"
 using std::map;
 using std::string;
 using std::ifstream;
 using std::set;
-using std::queue;
+using std::push_heap;
+using std::pop_heap;
+using std::make_pair;
 using std::vector;
 using std::pair;
 using std::cout;
 using std::endl;
 using std::min;
+using std::max;
+using std::thread;
+using std::string_view;
+using std::shared_ptr;
+using std::make_shared;
 
 #define INF (10001)
 /**
  * For metro usage, 10001 is large enough.
  * */
 
+#define INTERCHANGE_TIME (2)
+/**
+ * Minutes added to the route for each interchange between two lines.
+ * */
+
+#define DISTANCE_UNIT (100)
+/**
+ * Distances are stored as integers in 0.01 km units, the precision of the
+ * data files. Dividing by DISTANCE_UNIT gives back exactly the parsed value.
+ * */
+
+#define FARE_TABLE_SIZE (256 * DISTANCE_UNIT)
+/**
+ * Fares of charge segments shorter than this, in DISTANCE_UNIT, are looked
+ * up in FARE_TABLE; longer ones are computed.
+ * */
+
+int fare_rule(const int &distance) {
+    /**
+     * Fare of a charge segment of distance, in DISTANCE_UNIT, by the rules
+     * on the formal website: 2 RMB for the first 4 km, then 1 RMB per 4 km
+     * up to 12 km, per 6 km up to 24 km and per 8 km beyond.
+     * */
+    const int U = DISTANCE_UNIT;
+    int ret = 2;
+    if(distance > 4 * U)
+        ret += (min(distance, 12 * U) - 4 * U + 4 * U - 1) / (4 * U);
+    if(distance > 12 * U)
+        ret += (min(distance, 24 * U) - 12 * U + 6 * U - 1) / (6 * U);
+    if(distance > 24 * U)
+        ret += (distance - 24 * U + 8 * U - 1) / (8 * U);
+    return ret;
+}
+
+struct FareTable {
+    /**
+     * Fare_rule of every distance below FARE_TABLE_SIZE, so that searches
+     * look fares up instead of dividing.
+     * */
+    unsigned char fare[FARE_TABLE_SIZE];
+
+    FareTable() {
+        for(int d = 0; d < FARE_TABLE_SIZE; ++d)
+            fare[d] = fare_rule(d);
+    }
+
+    int get(const int &distance) const {
+        return distance < FARE_TABLE_SIZE ? fare[distance] : fare_rule(distance);
+    }
+};
+
+const FareTable FARE_TABLE;
+
 struct Response {
     /**
      * A response structure for each query.
@@ -44,25 +120,73 @@ struct Response {
     }
 };
 
+struct Route {
+    /**
+     * The route of a response as station and line ids, so that answering
+     * copies no names. Metro::station_name and Metro::line_name give the
+     * names as views into the loaded network, and Metro::to_response the
+     * Response.
+     * Station: Every station passed in order; the station of an
+     *          interchange ends one segment and starts the next, as in
+     *          Response::path.
+     * Segment_begin, Segment_line: Where each line segment starts in
+     *                              station, with station.size() last, and
+     *                              the line of each segment.
+     * Hop_time, Money, Cost_time, Distance: As in Response.
+     * */
+    vector<int> station, segment_begin, segment_line, hop_time;
+    int money, cost_time;
+    double distance;
+
+    Route() {
+        money = cost_time = 0, distance = 0.;
+    }
+
+    void clear() {
+        /**
+         * Empty the route as for a query from a station to itself, keeping
+         * the memory of the arrays.
+         * */
+        station.clear(), segment_begin.clear();
+        segment_line.clear(), hop_time.clear();
+        money = cost_time = 0, distance = 0.;
+    }
+
+    int num_segment() const {
+        return segment_line.size();
+    }
+};
+
+size_t route_bytes(const Route &route) {
+    /**
+     * Bytes the arrays of route hold.
+     * */
+    return (route.station.capacity() + route.segment_begin.capacity() +
+            route.segment_line.capacity() + route.hop_time.capacity()) * sizeof(int);
+}
+
 struct Edge {
     /**
      * A structure store information of each pair of adjacent edge.
      * Start, End: start station and end station name.
+     * Subway: The subway line the edge is on.
      * Cost_time: The time consume on the edge.
      * Distance: The distance of the edge.
      * */
-    string start, end;
+    string start, end, subway;
     int cost_time;
     double distance;
 
     Edge(
             const string &start,
             const string &end,
+            const string &subway,
             const int &cost_time,
             const double &distance
         ) :
         start(start),
         end(end),
+        subway(subway),
         cost_time(cost_time),
         distance(distance) {
     }
@@ -79,11 +203,8 @@ struct Edge {
 struct State {
     /**
      * A structure that record each station information from the start startion.
-     * The structure is used when working on Shortest Path.(Spfa)
-     * Pre_station: The previous station of this station.
-     *              With the fact that no two subway line intersect with adjacent
-     *              two stations, pre_station and now_station can determine which
-     *              subway_line is on.
+     * The structure is used as the label of each node of the line-expanded
+     * graph when working on Shortest Path.(Dijkstra)
      * Cost_time: The time consumed.
      * Cost_money: The money consumed uptil the previous charge segment.
      *             For example, if user use APM, the user should pay the subway
@@ -93,243 +214,2270 @@ struct State {
      * Real_distance: The distance start from start station to previous charge
      *                segment.
      *                That is, the Total_distance is Real_distance plus Distance.
+     * Both distances are in DISTANCE_UNIT.
      * */
-    string pre_station;
     int cost_time, cost_money, interchange;
-    double distance, real_distance;
+    int distance, real_distance;
 
     State(
-            const string &pre_station = "",
             const int &cost_time = INF,
             const int &cost_money = INF,
             const int &interchange = INF,
-            const double &distance = INF
+            const int &distance = INF
         ):
-        pre_station(pre_station),
         cost_time(cost_time),
         cost_money(cost_money),
         interchange(interchange),
         distance(distance) {
-        real_distance = 0.;
+        real_distance = 0;
     }
 
     int get_cost() const {
         /**
-         * Get cost from start station to this station.
-         * Computing by the rules on the formal website.
-         * */
-        int ret = cost_money + 2;
-        const double EPS = 1e-5;
-        if(distance > 4. + EPS)
-            ret += ceil((min(distance, 12.) - 4. - EPS) / 4.);
-        if(distance > 12. + EPS)
-            ret += ceil((min(distance, 24.) - 12. - EPS) / 6.);
-        if(distance > 24. + EPS)
-            ret += ceil((distance - 24. - EPS) / 8.);
-        return ret;
+         * Get cost from start station to this station: what is paid for
+         * the closed charge segments plus the fare of the open one, see
+         * fare_rule.
+         * */
+        return cost_money + FARE_TABLE.get(distance);
     }
 
     double get_distance() const {
         /**
-         * Get total distance from start station to this station.
+         * Get total distance from start station to this station, in km.
          * Computing by the distance and real_distance.
          * */
-        double ret = distance + real_distance;
+        double ret = (double) (distance + real_distance) / DISTANCE_UNIT;
         return ret;
     }
 };
 
-struct Comp {
+/**
+ * Criteria a route can be optimized for. Each one is a policy type given as
+ * the template argument of Metro::search, so that comparing two labels is
+ * compiled down to comparing two integers.
+ * Key: The minimized value followed by its tie-breakers, packed into one
+ *      integer so that comparing keys compares them lexicographically.
+ *      Every part only grows along a route (except the charge segment
+ *      distance of money, which is only a tie-breaker), as Dijkstra needs.
+ * Value: The minimized value alone, in minutes, km, RMB or interchanges.
+ * */
+struct TimeCriterion {
+    static long long key(const State &a) {
+        return ((long long) a.cost_time << 32) | a.interchange;
+    }
+
+    static double value(const State &a) {
+        return a.cost_time;
+    }
+};
+
+struct DistanceCriterion {
+    static long long key(const State &a) {
+        return ((long long) (a.distance + a.real_distance) << 24)
+            | min(a.cost_time, (1 << 24) - 1);
+    }
+
+    static double value(const State &a) {
+        return a.get_distance();
+    }
+};
+
+struct MoneyCriterion {
+    static long long key(const State &a) {
+        return ((long long) a.get_cost() << 48)
+            | ((long long) min(a.distance, (1 << 30) - 1) << 16)
+            | min(a.cost_time, (1 << 16) - 1);
+    }
+
+    static double value(const State &a) {
+        return a.get_cost();
+    }
+};
+
+struct InterchangeCriterion {
+    static long long key(const State &a) {
+        return ((long long) a.interchange << 32) | a.cost_time;
+    }
+
+    static double value(const State &a) {
+        return a.interchange;
+    }
+};
+
+const char *CRITERION_NAME[] = {
+    "Time",
+    "Distance",
+    "Money",
+    "Interchange"
+};
+#define NUM_CRITERION (4)
+#define CRITERION_TIME (0)
+#define CRITERION_DISTANCE (1)
+#define CRITERION_MONEY (2)
+#define CRITERION_INTERCHANGE (3)
+
+int get_criterion(const string &dominate) {
+    /**
+     * Index of dominate in CRITERION_NAME. Both "Money" and "money" are
+     * accepted, anything unknown means time.
+     * */
+    for(int i = 1; i < NUM_CRITERION; ++i) {
+        string name = CRITERION_NAME[i];
+        if(dominate == name) return i;
+        name[0] = name[0] - 'A' + 'a';
+        if(dominate == name) return i;
+    }
+    return 0;
+}
+
+#define NO_ENTRY (0xFFFF)
+#define SEARCH_ENTRY (0xFFFE)
+
+#define ROUTE_TABLE_BUDGET ((size_t) 1 << 30)
+/**
+ * Most bytes the route tables of all criteria may take. They grow with the
+ * square of the stations, so a larger network uses the hierarchy instead.
+ * */
+
+#define ALTERNATIVE_MAX_SCAN (8)
+/**
+ * Routes query_alternatives may look at for each one it returns, counting
+ * the near-duplicates it leaves out.
+ * */
+
+#define TIMETABLE_MAX_ROUND (10)
+/**
+ * Most trains a timetable query rides, that is interchanges plus one.
+ * */
+
+struct RouteTable {
+    /**
+     * Answers of every pair of stations under one criterion, filled by
+     * Metro::precompute_routes.
+     * Target, Money, Cost_time, Distance are stored for pair (start, end) at
+     * start * (tot_station + 1) + end.
+     * Target: The node the route ends on, NO_ENTRY if end is not reachable,
+     *         SEARCH_ENTRY if the route in the tree is not the one the search
+     *         gives, and the pair is searched when asked.
+     * Money, Cost_time, Distance: Values of the response, distance in
+     *                             DISTANCE_UNIT.
+     * Pre: The arc reaching node x in the shortest path tree from start,
+     *      stored at start * num_node + x, NO_ENTRY for the root.
+     * */
+    vector<unsigned short> target, money, cost_time, pre;
+    vector<int> distance;
+};
+
+struct ShortestPathTree {
+    /**
+     * Result of a one-to-all query from start, every vector is indexed by
+     * station index (index 0 is unused).
+     * Money, Cost_time, Interchange, Distance: Values of the route to each
+     *                                          station, INF if it is not
+     *                                          reached.
+     * Pre_station: The station before each station on its route, 0 for
+     *              start and for stations not reached.
+     * Stations: The reached stations, in the order they were settled, so
+     *           that the best comes first.
+     * Target, Pre, Parent: The entry each route ends on (-1 if not
+     *                      reached), the arc every entry is reached by and
+     *                      the entry before it (-1 at the start), used to
+     *                      rebuild full routes. Entries are the nodes of
+     *                      the search, except for money where they are the
+     *                      labels of fare_search, since the cheapest routes
+     *                      to two stations may reach one node different
+     *                      ways.
+     * */
+    int start;
+    vector<int> money, cost_time, interchange, pre_station, stations;
+    vector<double> distance;
+    vector<int> target, pre, parent;
+};
+
+#define PARETO_MAX_LABEL (32)
+/**
+ * Most labels kept at one node by the Pareto search. A node only holds
+ * labels no other of its labels dominates, and on the metro there are
+ * rarely more than a few; the bound keeps a pathological network from
+ * blowing up the search. Once a node is full, later labels are dropped.
+ * */
+
+struct ParetoLabel {
+    /**
+     * A partial route of the Pareto search.
+     * State: Its costs. Node, Arc: The node it ends at and the arc it came
+     * by. Parent: The label it extends, -1 at the start.
+     * Dead: Whether a label found later dominates it.
+     * */
+    State state;
+    int node, arc, parent;
+    bool dead;
+};
+
+struct Disruption {
+    /**
+     * Disruptions on top of the loaded network, see Metro::close_station.
+     * A version is never changed once queries can see it: Metro::disrupt
+     * changes a copy and publishes that instead.
+     * Station_closed, Edge_closed, Edge_delay: Closed stations, closed
+     *                                          edges, and minutes added
+     *                                          to each edge.
+     * Edge_time: Minutes of each edge, delays included.
+     * Arc_closed: Whether each arc is closed; every search skips them.
+     * Arc_disrupted: Whether each arc is closed or slower than loaded,
+     *                num_disrupted of them.
+     * Route_delay: Minutes trains reach each stop of the timetable late
+     *              because of slowed sections before it.
+     * */
+    vector<int> edge_time, edge_delay, route_delay;
+    vector<char> station_closed, edge_closed, arc_closed, arc_disrupted;
+    int num_disrupted;
+
+    Disruption() {
+        num_disrupted = 0;
+    }
+
+    size_t memory() const {
+        /**
+         * Bytes held by the arrays.
+         * */
+        return (edge_time.capacity() + edge_delay.capacity() +
+                route_delay.capacity()) * sizeof(int) +
+            station_closed.capacity() + edge_closed.capacity() +
+            arc_closed.capacity() + arc_disrupted.capacity();
+    }
+};
+
+struct SearchWorkspace {
     /**
-     * A self-define comparator. Set with a string with following:
-     * "Money" or "money": To find a path with money consume least.
-     * "Distance" or "distance": To find a path with distance least.
-     * "Interchange" or "interchange": to find a path with least interchanges.
-     * Defaultly: To find a path with time consumed least.
+     * Buffers of a search, kept between queries so that they are allocated
+     * once. A workspace must not be shared by two threads at the same time.
+     * Dist, Key, Pre: Label, its key and the arc it was reached by of each
+     *                 node.
+     * Done: Whether each node is settled.
+     * Stamp, Generation: The labels of node x belong to the current search
+     *                    only if stamp[x] == generation; reach resets them
+     *                    on first use, so starting a search costs nothing
+     *                    however large the network is. Back_stamp and
+     *                    Potential_stamp do the same for the backward half
+     *                    and the potentials of the landmark search.
+     * Settled: Nodes in the order they were settled.
+     * Heap: Keys waiting to be settled, with their nodes.
+     * Arcs: Arcs of the route found.
+     * Labels, Bag, Bucket: Labels of the Pareto search, the live ones
+     *                      of each node, and the ones waiting to be
+     *                      expanded by their cost_time.
+     * Arrival, Ride_route, Ride_board: Earliest arrival at each station in
+     *                                  each round of the timetable search,
+     *                                  with the route and the stop boarded.
+     * Best_arrival: Earliest arrival at each station in any round.
+     * Route_first, Route_list: First stop to scan of each route queued
+     *                          for a round, -1 if not queued, and the
+     *                          queued routes.
+     * Marked, Marked_list: Stations improved in the last round.
+     * Blocked_node, Blocked_arc: Nodes and arcs a spur search of
+     *                            query_alternatives must not use.
+     * Back_key, Back_pre, Back_done, Back_heap: The backward half of the
+     *                                           landmark search, Back_pre
+     *                                           being the arc leaving each
+     *                                           node towards the end.
+     * Potential: Landmark potential of each node, INT_MIN until needed.
+     * Bound: Landmark distances of the start and end of a query.
+     * Upward: Buffers of the contraction hierarchy search.
+     * Counters: Work of the searches made since they were last cleared.
+     * Path_stamp, Path_generation: The stations on the route of the label
+     *                              fare_search expands are those with
+     *                              path_stamp equal to path_generation.
+     * Disruption: The disruptions the searches run under, held by the
+     *             query for as long as it uses the workspace.
      * */
-    string dominate;
+    vector<State> dist;
+    vector<long long> key;
+    vector<int> pre, settled, arcs;
+    vector<bool> done;
+    vector<pair<long long, int> > heap;
+    vector<ParetoLabel> labels;
+    vector<vector<int> > bag, bucket;
+    vector<int> arrival, ride_route, ride_board, best_arrival;
+    vector<int> route_first, route_list, marked_list;
+    vector<bool> marked, blocked_node, blocked_arc;
+    vector<long long> back_key;
+    vector<int> back_pre, potential, bound;
+    vector<bool> back_done;
+    vector<pair<long long, int> > back_heap;
+    vector<unsigned> stamp, back_stamp, potential_stamp;
+    unsigned generation;
+    HierarchyWorkspace upward;
+    SearchCounters counters;
+    vector<unsigned> path_stamp;
+    unsigned path_generation;
+    const Disruption *disruption;
+
+    SearchWorkspace() {
+        generation = path_generation = 0;
+        disruption = NULL;
+    }
 
-    Comp(const char *dominate):dominate(dominate) {}
+    bool reached(const int &x) const {
+        return stamp[x] == generation;
+    }
+
+    void reach(const int &x) {
+        if(stamp[x] == generation) return;
+        stamp[x] = generation;
+        dist[x] = State(), key[x] = LLONG_MAX, pre[x] = -1, done[x] = false;
+    }
 
-    bool operator ()(const State &a, const State &b) {
-        if(dominate == "Distance" || dominate == "distance")
-            return a.get_distance() < b.get_distance();
-        if(dominate == "Money" || dominate == "money")
-            return a.get_cost() < b.get_cost();
-        if(dominate == "Interchange" || dominate == "interchange")
-            return a.interchange < b.interchange;
-        return a.cost_time < b.cost_time;
+    void reach_back(const int &x) {
+        if(back_stamp[x] == generation) return;
+        back_stamp[x] = generation;
+        back_key[x] = LLONG_MAX, back_pre[x] = -1, back_done[x] = false;
     }
 };
 
+#define NUM_LANDMARK (8)
+/**
+ * Landmarks precompute_landmarks picks by default.
+ * */
+
+struct LandmarkIndex {
+    /**
+     * Landmark distances for the goal-directed search, built by
+     * precompute_landmarks for the time (metric 0) and distance (metric 1)
+     * criteria.
+     * Landmark: Station of each landmark.
+     * Rev_begin, Rev_arc: Arcs entering each node; those entering node x
+     *                     are [rev_begin[x], rev_begin[x + 1]).
+     * To, From: Shortest time or distance from each node to each landmark
+     *           and from each landmark to each node, at
+     *           landmark * number of nodes + node. INT_MAX if unreachable.
+     * */
+    vector<int> landmark, rev_begin, rev_arc;
+    vector<int> to[2], from[2];
+};
+
 
 class Metro {
     /**
      * Manage class ofr GuangZhou metro.
+     * Queries are const and may run from any number of threads at once,
+     * as may disruptions, enable_cache and disable_cache, which publish
+     * new versions instead of changing what queries read. Loading,
+     * precomputing, enable_stats and share_stats change the network in
+     * place, so they must not run while another thread queries the same
+     * Metro; to change those under live queries, build a new Metro and
+     * publish it, as main.cpp serves an RcuPointer<const Metro>.
      * */
 private :
-    map<string, int> station_name_index;
-    map<int, string> station_index_name;
-    map<string, set<string> > subway_stations, station_belong;
-    map<string, set<Edge> > graph;
-    int tot_station;
+    /**
+     * The loaded network as flat arrays, see NETWORK_ARRAYS. They view
+     * either network_data, when loaded from the text data, or snapshot,
+     * when loaded from a snapshot file.
+     *
+     * The station graph is in compressed-sparse-row form.
+     * Edges leaving station u are stored in [adj_begin[u], adj_begin[u + 1]),
+     * ordered by the name of the end station.
+     * Adj_station: End station index of each edge.
+     * Adj_time: Time consumed on each edge.
+     * Adj_distance: Distance of each edge, in DISTANCE_UNIT.
+     * Adj_subway: Index of the line the edge is on.
+     *
+     * The line-expanded graph is built from the station graph.
+     * Every node is a station together with one line serving it, nodes of
+     * station u are [station_node_begin[u], station_node_begin[u + 1]).
+     * Riding arcs follow an adjacency edge along one line, interchange arcs
+     * link the nodes of one station and cost INTERCHANGE_TIME.
+     * Node_station, Node_subway: Station and line of each node.
+     * Arc_from, Arc_node: Start and end node of each arc, arcs leaving node
+     *                     x are stored in [arc_begin[x], arc_begin[x + 1]).
+     * Arc_edge: The adjacency edge an arc rides along, -1 for interchanges.
+     * */
+#define DECLARE_ARRAY(type, name) ArrayRef<type> name;
+    NETWORK_ARRAYS(DECLARE_ARRAY)
+#undef DECLARE_ARRAY
+    NetworkArrays network_data;
+    SnapshotFile snapshot;
+    int tot_station, tot_subway;
+
+    /**
+     * Directory of the line and timetable files, "data" unless the network
+     * is loaded by load_manifest.
+     * */
+    string data_directory;
+
+    /**
+     * Precomputed answers of each criterion in CRITERION_NAME, empty until
+     * precompute_routes is called.
+     * */
+    vector<RouteTable> route_tables;
+
+    /**
+     * Optional cache of answered queries, NULL unless enable_cache is
+     * called. Published like disruptions, so that the cache can be
+     * replaced or dropped while queries use it.
+     * */
+    RcuPointer<const RouteCache<Route> > route_cache;
+
+    /**
+     * Counters of answered queries, NULL unless enable_stats is called.
+     * Shared with the Metro it replaces after share_stats.
+     * */
+    shared_ptr<QueryRecorder> query_recorder;
+
+    /**
+     * Threads of query_batch and the precomputations, created with the
+     * Metro so that query_batch changes nothing and can be const.
+     * */
+    ThreadPool *batch_pool;
+
+    /**
+     * Routes and trips of every line for query_departure, rebuilt whenever
+     * the network changes. Lines without a timetable file can be boarded
+     * at any time.
+     * */
+    Timetable timetable;
+
+    /**
+     * Landmarks of the goal-directed search, empty unless
+     * precompute_landmarks is called.
+     * */
+    LandmarkIndex landmarks;
+
+    /**
+     * Contraction hierarchies of the time (0) and distance (1) criteria,
+     * empty unless precompute_hierarchy or load_hierarchy is called.
+     * */
+    ContractionHierarchy hierarchy[2];
+
+    /**
+     * Station names for match_station, rebuilt whenever the network is
+     * loaded.
+     * */
+    StationIndex station_index;
+
+    /**
+     * Disruptions applied on top of the loaded network, see close_station,
+     * close_section and slow_section. The arrays of the network are left
+     * as loaded. Every query reads the current version of disruptions for
+     * as long as it runs, so a disruption never changes what a query is
+     * searching; disruption_lock keeps disruptions made at the same time
+     * from losing each other.
+     * Route tables, landmarks and hierarchies are built on loaded, the
+     * network with no disruption. Since a disruption only closes arcs or
+     * makes them slower, a route they give that avoids every disrupted
+     * arc is still the best one, so they are kept and only answers
+     * crossing a disruption fall back to searching.
+     * */
+    Disruption loaded;
+    RcuPointer<const Disruption> disruptions;
+    std::mutex disruption_lock;
+
+    Metro(const Metro &);
+    Metro &operator =(const Metro &);
+
+    static int get_station_index(
+            map<string, int> &station_name_index,
+            vector<string> &station_index_name,
+            const string &name
+            ) {
+        /**
+         * Different from query_station_index, it will automatically add the name
+         * to database if this name not exists.
+         * */
+        map<string, int>::iterator it = station_name_index.find(name);
+        if(it != station_name_index.end()) return it->second;
+        station_name_index[name] = station_index_name.size();
+        station_index_name.push_back(name);
+        return station_index_name.size() - 1;
+    }
+
+    static void build_names(
+            NetworkArrays &data,
+            const vector<string> &station_index_name,
+            const map<string, set<string> > &subway_stations,
+            const map<string, int> &station_name_index
+            ) {
+        /**
+         * Fill the string pool, the station order by name and the line
+         * tables.
+         * */
+        int num_station = station_index_name.size() - 1;
+        data.name_pool.assign(1, '\0');
+        data.station_name_begin.assign(num_station + 2, 0);
+        for(int u = 1; u <= num_station; ++u) {
+            data.station_name_begin[u] = data.name_pool.size();
+            const string &name = station_index_name[u];
+            data.name_pool.insert(data.name_pool.end(), name.begin(), name.end());
+            data.name_pool.push_back('\0');
+        }
+        data.station_name_begin[num_station + 1] = data.name_pool.size();
+
+        data.station_by_name.clear();
+        for(map<string, int>::const_iterator it = station_name_index.begin();
+                it != station_name_index.end(); ++it)
+            data.station_by_name.push_back(it->second);
+
+        data.subway_name_begin.clear(), data.subway_fare_free.clear();
+        data.subway_station_begin.clear(), data.subway_station.clear();
+        for(map<string, set<string> >::const_iterator
+                it = subway_stations.begin();
+                it != subway_stations.end(); ++it) {
+            data.subway_name_begin.push_back(data.name_pool.size());
+            data.name_pool.insert(data.name_pool.end(),
+                    it->first.begin(), it->first.end());
+            data.name_pool.push_back('\0');
+            data.subway_fare_free.push_back(it->first.compare(0, 3, "APM") == 0);
+            data.subway_station_begin.push_back(data.subway_station.size());
+            for(set<string>::const_iterator
+                    name = it->second.begin();
+                    name != it->second.end(); ++name) {
+                map<string, int>::const_iterator
+                    index = station_name_index.find(*name);
+                if(index != station_name_index.end())
+                    data.subway_station.push_back(index->second);
+            }
+        }
+        data.subway_name_begin.push_back(data.name_pool.size());
+        data.subway_station_begin.push_back(data.subway_station.size());
+    }
+
+    static void build_adjacency(
+            NetworkArrays &data,
+            map<string, set<Edge> > &graph,
+            const vector<string> &station_index_name,
+            const map<string, set<string> > &subway_stations,
+            const map<string, int> &station_name_index
+            ) {
+        /**
+         * Flatten the loaded adjacency sets into the compressed-sparse-row
+         * arrays, so searching never touches a station or line name.
+         * */
+        map<string, int> subway_index;
+        for(map<string, set<string> >::const_iterator
+                it = subway_stations.begin();
+                it != subway_stations.end(); ++it) {
+            int index = subway_index.size();
+            subway_index[it->first] = index;
+        }
+
+        int num_station = station_index_name.size() - 1;
+        data.adj_begin.assign(num_station + 2, 0);
+        data.adj_station.clear(), data.adj_time.clear();
+        data.adj_distance.clear(), data.adj_subway.clear();
+        for(int u = 1; u <= num_station; ++u) {
+            data.adj_begin[u] = data.adj_station.size();
+            set<Edge> &edges = graph[station_index_name[u]];
+            for(set<Edge>::iterator e = edges.begin(); e != edges.end(); ++e) {
+                data.adj_station.push_back(station_name_index.find(e->end)->second);
+                data.adj_time.push_back(e->cost_time);
+                data.adj_distance.push_back(
+                        (int) floor(e->distance * DISTANCE_UNIT + 0.5)
+                    );
+                data.adj_subway.push_back(subway_index[e->subway]);
+            }
+        }
+        data.adj_begin[num_station + 1] = data.adj_station.size();
+    }
+
+    static int get_node(
+            const NetworkArrays &data,
+            const int &station,
+            const int &subway
+            ) {
+        /**
+         * Find the node of the line-expanded graph for station on subway.
+         * Return -1 if the subway does not serve the station.
+         * */
+        for(int x = data.station_node_begin[station];
+                x < data.station_node_begin[station + 1]; ++x)
+            if(data.node_subway[x] == subway) return x;
+        return -1;
+    }
+
+    static void build_expanded_graph(NetworkArrays &data) {
+        /**
+         * Split every station into one node per line serving it, then link
+         * the nodes by riding arcs along the adjacency edges and by
+         * interchange arcs inside each station.
+         * */
+        int num_station = data.adj_begin.size() - 2;
+        data.station_node_begin.assign(num_station + 2, 0);
+        data.node_station.clear(), data.node_subway.clear();
+        for(int u = 1; u <= num_station; ++u) {
+            data.station_node_begin[u] = data.node_station.size();
+            set<int> subways;
+            for(int e = data.adj_begin[u]; e < data.adj_begin[u + 1]; ++e)
+                subways.insert(data.adj_subway[e]);
+            for(set<int>::iterator it = subways.begin(); it != subways.end(); ++it)
+                data.node_station.push_back(u), data.node_subway.push_back(*it);
+        }
+        data.station_node_begin[num_station + 1] = data.node_station.size();
+
+        int num_node = data.node_station.size();
+        data.arc_begin.assign(num_node + 1, 0);
+        data.arc_from.clear(), data.arc_node.clear(), data.arc_edge.clear();
+        for(int x = 0; x < num_node; ++x) {
+            data.arc_begin[x] = data.arc_node.size();
+            int u = data.node_station[x], subway = data.node_subway[x];
+            for(int e = data.adj_begin[u]; e < data.adj_begin[u + 1]; ++e) {
+                if(data.adj_subway[e] != subway) continue;
+                data.arc_from.push_back(x);
+                data.arc_node.push_back(get_node(data, data.adj_station[e], subway));
+                data.arc_edge.push_back(e);
+            }
+            for(int y = data.station_node_begin[u];
+                    y < data.station_node_begin[u + 1]; ++y) {
+                if(y == x) continue;
+                data.arc_from.push_back(x);
+                data.arc_node.push_back(y);
+                data.arc_edge.push_back(-1);
+            }
+        }
+        data.arc_begin[num_node] = data.arc_node.size();
+    }
+
+    void bind_network_data() {
+        /**
+         * Point the arrays at network_data.
+         * */
+#define BIND_ARRAY(type, name) name = ArrayRef<type>(network_data.name);
+        NETWORK_ARRAYS(BIND_ARRAY)
+#undef BIND_ARRAY
+        snapshot.close();
+        bind_counts();
+    }
+
+    bool bind_snapshot() {
+        /**
+         * Point the arrays into the opened snapshot and check that they
+         * describe a consistent network.
+         * */
+        int k = 0;
+        bool ok = true;
+#define BIND_ARRAY(type, name) ok = snapshot.get_array(k++, name) && ok;
+        NETWORK_ARRAYS(BIND_ARRAY)
+#undef BIND_ARRAY
+        ok = ok && station_name_begin.size() >= 2
+            && adj_begin.size() == station_name_begin.size()
+            && station_node_begin.size() == station_name_begin.size()
+            && arc_begin.size() == node_station.size() + 1
+            && subway_name_begin.size() == subway_fare_free.size() + 1
+            && subway_station_begin.size() == subway_name_begin.size()
+            && station_by_name.size() == station_name_begin.size() - 2
+            && !name_pool.empty() && name_pool[name_pool.size() - 1] == '\0';
+        if(ok) bind_counts();
+        return ok;
+    }
+
+    void bind_counts() {
+        tot_station = station_name_begin.size() - 2;
+        tot_subway = subway_name_begin.size() - 1;
+        if(tot_station < 0) tot_station = 0;
+        if(tot_subway < 0) tot_subway = 0;
+    }
+
+    void reset_disruptions() {
+        /**
+         * Open every station and section at its loaded time, once the
+         * timetable is built.
+         * */
+        loaded.station_closed.assign(tot_station + 1, false);
+        loaded.edge_closed.assign(adj_station.size(), false);
+        loaded.edge_delay.assign(adj_station.size(), 0);
+        loaded.edge_time.assign(adj_time.data, adj_time.data + adj_time.size());
+        loaded.route_delay.assign(timetable.route_stop.size(), 0);
+        loaded.arc_closed.assign(arc_node.size(), false);
+        loaded.arc_disrupted.assign(arc_node.size(), false);
+        loaded.num_disrupted = 0;
+        disruptions.publish(new Disruption(loaded));
+    }
+
+    void clear_cache() const {
+        /**
+         * Drop every cached answer, if there is a cache.
+         * */
+        RcuPointer<const RouteCache<Route> >::Guard cache(route_cache);
+        if(cache.get() != NULL) cache->clear();
+    }
+
+    void network_changed() {
+        /**
+         * Drop everything derived from the previous network, disruptions
+         * included.
+         * */
+        clear_cache();
+        build_timetable();
+        reset_disruptions();
+        build_station_index();
+        if(!landmarks.landmark.empty())
+            precompute_landmarks(landmarks.landmark.size());
+        if(!hierarchy[0].empty())
+            precompute_hierarchy();
+        if(!route_tables.empty()) {
+            route_tables.clear();
+            precompute_routes();
+        }
+    }
+
+    void build_station_index() {
+        /**
+         * Index the station names. A station is as popular as it has
+         * sections, so interchanges rank above other stations and
+         * terminals below.
+         * */
+        vector<string_view> names(tot_station + 1);
+        vector<int> popularity(tot_station + 1, 0);
+        for(int u = 1; u <= tot_station; ++u) {
+            names[u] = station_name(u);
+            popularity[u] = adj_begin[u + 1] - adj_begin[u];
+        }
+        station_index.build(names, popularity);
+    }
+
+    bool line_order(const int &subway, vector<int> &stops, vector<int> &offsets) const {
+        /**
+         * The stations of a line from one end to the other, with the minutes
+         * from the first one. Return false if the line is not a simple path.
+         * */
+        stops.clear(), offsets.clear();
+        int head = -1, num_station = 0;
+        for(int i = subway_station_begin[subway]; i < subway_station_begin[subway + 1]; ++i) {
+            int u = subway_station[i], degree = 0;
+            for(int e = adj_begin[u]; e < adj_begin[u + 1]; ++e)
+                if(adj_subway[e] == subway) ++degree;
+            if(degree > 2) return false;
+            if(degree <= 1 && head == -1) head = u;
+            ++num_station;
+        }
+        for(int u = head, from = -1, time = 0; u != -1; ) {
+            stops.push_back(u), offsets.push_back(time);
+            int next = -1;
+            for(int e = adj_begin[u]; e < adj_begin[u + 1]; ++e)
+                if(adj_subway[e] == subway && adj_station[e] != from) {
+                    next = adj_station[e], time += adj_time[e];
+                    break;
+                }
+            from = u, u = next;
+            if((int) stops.size() > num_station) return false;
+        }
+        return (int) stops.size() == num_station && num_station > 0;
+    }
+
+    void build_timetable() {
+        /**
+         * Split every line into its two directions and expand the timetable
+         * file LINE.timetable.txt of the data directory into trips, if there
+         * is one.
+         * */
+        timetable.clear();
+        vector<int> stops, offsets, trips, back_stops, back_offsets, arcs;
+        vector<TimetableEntry> entries;
+        for(int l = 0; l < tot_subway; ++l) {
+            if(!line_order(l, stops, offsets)) continue;
+            bool continuous = !read_timetable(
+                    data_file(get_subway_name(l) + ".timetable.txt"), entries);
+            back_stops.assign(stops.rbegin(), stops.rend());
+            back_offsets.clear();
+            for(int i = stops.size() - 1; i >= 0; --i)
+                back_offsets.push_back(offsets.back() - offsets[i]);
+            for(int d = 0; d < 2; ++d) {
+                const vector<int> &now_stops = d ? back_stops : stops;
+                string first = get_station_name(now_stops[0]);
+                arcs.assign(1, -1);
+                for(size_t i = 1; i < now_stops.size(); ++i)
+                    arcs.push_back(arc_to(node_of(now_stops[i - 1], l), node_of(now_stops[i], l)));
+                trips.clear();
+                for(size_t i = 0; i < entries.size(); ++i)
+                    if(entries[i].from.empty() || entries[i].from == first)
+                        for(int t = entries[i].first; t <= entries[i].last;
+                                t += entries[i].headway)
+                            trips.push_back(t);
+                timetable.add_route(l, now_stops, d ? back_offsets : offsets,
+                        arcs, trips, continuous);
+            }
+        }
+        timetable.index_stations(tot_station);
+    }
+
+    int node_of(const int &station, const int &subway) const {
+        /**
+         * Node of station on a line serving it, -1 if there is none.
+         * */
+        for(int x = station_node_begin[station]; x < station_node_begin[station + 1]; ++x)
+            if(node_subway[x] == subway) return x;
+        return -1;
+    }
+
+    int arc_to(const int &x, const int &y) const {
+        /**
+         * The arc from node x to node y, -1 if there is none.
+         * */
+        for(int a = arc_begin[x]; a < arc_begin[x + 1]; ++a)
+            if(arc_node[a] == y) return a;
+        return -1;
+    }
+
+    int raptor(
+            const int &start,
+            const int &end,
+            const int &departure,
+            SearchWorkspace &workspace
+            ) const {
+        /**
+         * Round-based earliest arrival search on the timetable. Round k
+         * finds the earliest arrival at every station riding k trains: each
+         * route serving a station improved in round k - 1 is scanned once
+         * from that station on, boarding the earliest trip that can be
+         * caught, INTERCHANGE_TIME after arriving by another train. A ride
+         * ends before a closed section.
+         * Return the round of the earliest arrival at end, -1 if none.
+         * */
+        int width = tot_station + 1;
+        const Disruption &disruption = *workspace.disruption;
+        vector<int> &arrival = workspace.arrival, &best = workspace.best_arrival;
+        vector<int> &first = workspace.route_first, &queued = workspace.route_list;
+        vector<int> &marked_list = workspace.marked_list;
+        vector<bool> &marked = workspace.marked;
+        arrival.assign(width * (TIMETABLE_MAX_ROUND + 1), INT_MAX);
+        workspace.ride_route.resize(width * (TIMETABLE_MAX_ROUND + 1));
+        workspace.ride_board.resize(width * (TIMETABLE_MAX_ROUND + 1));
+        best.assign(width, INT_MAX);
+        first.assign(timetable.size(), -1);
+        marked.assign(width, false);
+        marked_list.clear();
+
+        arrival[start] = best[start] = departure;
+        marked[start] = true, marked_list.push_back(start);
+        int found = -1;
+        for(int k = 1; k <= TIMETABLE_MAX_ROUND && !marked_list.empty(); ++k) {
+            queued.clear();
+            for(size_t i = 0; i < marked_list.size(); ++i) {
+                int u = marked_list[i];
+                marked[u] = false;
+                for(int j = timetable.station_route_begin[u];
+                        j < timetable.station_route_begin[u + 1]; ++j) {
+                    int r = timetable.station_route[j];
+                    int stop = timetable.station_route_stop[j];
+                    if(first[r] == -1) queued.push_back(r);
+                    if(first[r] == -1 || stop < first[r]) first[r] = stop;
+                }
+            }
+            marked_list.clear();
+
+            int *last_round = &arrival[width * (k - 1)], *now = &arrival[width * k];
+            for(size_t q = 0; q < queued.size(); ++q) {
+                int r = queued[q], trip = 0, board = -1;
+                for(int i = first[r]; i < timetable.route_stop_begin[r + 1]; ++i) {
+                    int u = timetable.route_stop[i];
+                    if(board != -1 && disruption.arc_closed[timetable.route_arc[i]])
+                        board = -1;
+                    if(board != -1) {
+                        int t = timetable.arrival(i, trip, disruption.route_delay);
+                        if(t < best[u] && t < best[end]) {
+                            now[u] = best[u] = t;
+                            workspace.ride_route[width * k + u] = r;
+                            workspace.ride_board[width * k + u] = board;
+                            if(u == end) found = k;
+                            if(!marked[u]) marked[u] = true, marked_list.push_back(u);
+                        }
+                    }
+                    if(last_round[u] == INT_MAX) continue;
+                    int ready = last_round[u] + (k > 1 ? INTERCHANGE_TIME : 0), next;
+                    if(timetable.next_trip(r, i, ready, disruption.route_delay, next) &&
+                            (board == -1 || next < trip))
+                        trip = next, board = i;
+                }
+                first[r] = -1;
+            }
+        }
+        return found;
+    }
+
+    string get_station_name(const int &index) const {
+        /**
+         * Name of a valid station index.
+         * */
+        return string(&name_pool[station_name_begin[index]]);
+    }
+
+    string get_subway_name(const int &subway) const {
+        /**
+         * Name of a valid line index.
+         * */
+        return string(&name_pool[subway_name_begin[subway]]);
+    }
+
+    string data_file(const string &name) const {
+        /**
+         * Path of the file name in the data directory.
+         * */
+        #ifdef WIN32
+        return data_directory + "\\" + name;
+        #else
+        return data_directory + "/" + name;
+        #endif
+    }
+
+    void parse_route(
+            const State &label,
+            const vector<int> &arcs,
+            const Disruption &disruption,
+            Route &ret
+            ) const {
+        /**
+         * Fill ret with the route recorded by a shortest-path algorithm.
+         * Label is the state of the last node, arcs are the arcs along the
+         * route from start to end, empty if end is not reachable, timed
+         * under disruption.
+         * */
+        ret.clear();
+        if(arcs.empty()) {
+            ret.money = ret.cost_time = INF, ret.distance = INF;
+            return;
+        }
+        ret.money = label.get_cost();
+        ret.cost_time = label.cost_time;
+        ret.distance = label.get_distance();
+
+        ret.station.push_back(node_station[arc_from[arcs[0]]]);
+        ret.segment_begin.push_back(0);
+        int interchange_time = 0;
+        for(int i = 0; i < (int) arcs.size(); ++i) {
+            int a = arcs[i], e = arc_edge[a];
+            if(e == -1) {
+                ret.segment_line.push_back(node_subway[arc_from[a]]);
+                ret.segment_begin.push_back(ret.station.size());
+                ret.station.push_back(node_station[arc_node[a]]);
+                interchange_time += INTERCHANGE_TIME;
+                continue;
+            }
+            ret.station.push_back(node_station[arc_node[a]]);
+            ret.hop_time.push_back(disruption.edge_time[e] + interchange_time);
+            interchange_time = 0;
+        }
+        ret.segment_line.push_back(node_subway[arc_node[arcs.back()]]);
+        ret.segment_begin.push_back(ret.station.size());
+    }
+
+    Response parse_response(
+            const State &label,
+            const vector<int> &arcs,
+            const Disruption &disruption
+            ) const {
+        /**
+         * Parse_route as a Response.
+         * */
+        Route route;
+        parse_route(label, arcs, disruption, route);
+        return to_response(route);
+    }
+
+    State relax(const State &pre_state, const int &arc, const Disruption &disruption) const {
+        /**
+         * The label reached by going along arc from a node labeled pre_state,
+         * under disruption.
+         * Riding a fare-free line (APM) closes the current charge segment;
+         * only getting on one without riding it does not.
+         * */
+        State now = pre_state;
+        int e = arc_edge[arc];
+        if(e == -1) {
+            now.cost_time += INTERCHANGE_TIME, ++now.interchange;
+            return now;
+        }
+        now.cost_time += disruption.edge_time[e];
+        if(subway_fare_free[adj_subway[e]]) {
+            now.cost_money = now.get_cost() - 2;
+            now.real_distance += now.distance + adj_distance[e];
+            now.distance = 0;
+        }
+        else now.distance += adj_distance[e];
+        return now;
+    }
+
+    void reset_search(SearchWorkspace &workspace) const {
+        /**
+         * Start a new search in workspace by moving to the next generation.
+         * The arrays are only filled when the network size changes or the
+         * generation wraps around.
+         * */
+        int num_node = node_station.size();
+        if((int) workspace.stamp.size() != num_node || ++workspace.generation == 0) {
+            workspace.dist.assign(num_node, State());
+            workspace.key.assign(num_node, LLONG_MAX);
+            workspace.pre.assign(num_node, -1);
+            workspace.done.assign(num_node, false);
+            workspace.back_key.assign(num_node, LLONG_MAX);
+            workspace.back_pre.assign(num_node, -1);
+            workspace.back_done.assign(num_node, false);
+            workspace.potential.assign(num_node, INT_MIN);
+            workspace.stamp.assign(num_node, 0);
+            workspace.back_stamp.assign(num_node, 0);
+            workspace.potential_stamp.assign(num_node, 0);
+            workspace.generation = 1;
+        }
+        workspace.heap.clear();
+        workspace.settled.clear();
+    }
+
+    void reset_labels(SearchWorkspace &workspace) const {
+        /**
+         * Empty the labels and bags of a multi-label search. Only the bags
+         * of nodes some label was left at are cleared.
+         * */
+        int num_node = node_station.size();
+        vector<ParetoLabel> &labels = workspace.labels;
+        vector<vector<int> > &bag = workspace.bag;
+        if((int) bag.size() != num_node) {
+            bag.clear();
+            bag.resize(num_node);
+        } else {
+            for(size_t i = 0; i < labels.size(); ++i)
+                bag[labels[i].node].clear();
+        }
+        labels.clear();
+    }
+
+    static SearchWorkspace &thread_workspace() {
+        /**
+         * The workspace of the calling thread, for queries answered one at
+         * a time and for the tasks the pool workers run, so that they
+         * allocate nothing once it has grown.
+         * */
+        static thread_local SearchWorkspace workspace;
+        return workspace;
+    }
+
+    template <class Criterion>
+    void seed(const int &x, const State &label, SearchWorkspace &workspace) const {
+        /**
+         * Start the search at node x with label.
+         * */
+        std::greater<pair<long long, int> > heap_cmp;
+        workspace.reach(x);
+        workspace.dist[x] = label;
+        workspace.key[x] = Criterion::key(label);
+        workspace.heap.push_back(make_pair(workspace.key[x], x));
+        ++workspace.counters.pushed;
+        push_heap(workspace.heap.begin(), workspace.heap.end(), heap_cmp);
+    }
+
+    template <class Criterion, bool Blocking>
+    int settle(const int &end, SearchWorkspace &workspace, const double &limit) const {
+        /**
+         * Shortest path algorithm on the line-expanded graph, from the
+         * seeded nodes.
+         * Every key of Criterion only grows along a route, so each node is
+         * settled once and the first node of end taken from the heap is the
+         * answer. Return that node, or -1 if end is not reachable. With end 0
+         * the whole network is searched.
+         * Nodes whose Criterion::value is over limit are never settled.
+         * With Blocking, nodes and arcs marked in workspace.blocked_node and
+         * workspace.blocked_arc are left out.
+         * The labels and predecessors are left in workspace.
+         * */
+        const Disruption &disruption = *workspace.disruption;
+        vector<State> &dist = workspace.dist;
+        vector<long long> &key = workspace.key;
+        vector<int> &pre = workspace.pre;
+        vector<bool> &done = workspace.done;
+        vector<pair<long long, int> > &heap = workspace.heap;
+        std::greater<pair<long long, int> > heap_cmp;
+        while(!heap.empty()) {
+            int x = heap.front().second;
+            pop_heap(heap.begin(), heap.end(), heap_cmp);
+            heap.pop_back();
+            if(done[x]) continue;
+            if(Criterion::value(dist[x]) > limit) break;
+            done[x] = true;
+            workspace.settled.push_back(x);
+            ++workspace.counters.settled;
+            if(node_station[x] == end) return x;
+            for(int a = arc_begin[x]; a < arc_begin[x + 1]; ++a) {
+                int y = arc_node[a];
+                if(disruption.arc_closed[a]) continue;
+                ++workspace.counters.relaxed;
+                workspace.reach(y);
+                if(done[y]) continue;
+                if(Blocking && (workspace.blocked_node[y] || workspace.blocked_arc[a]))
+                    continue;
+                State now = relax(dist[x], a, disruption);
+                long long now_key = Criterion::key(now);
+                if(now_key < key[y]) {
+                    if(key[y] != LLONG_MAX) ++workspace.counters.repushed;
+                    ++workspace.counters.pushed;
+                    dist[y] = now, key[y] = now_key, pre[y] = a;
+                    heap.push_back(make_pair(now_key, y));
+                    push_heap(heap.begin(), heap.end(), heap_cmp);
+                }
+            }
+        }
+        return -1;
+    }
+
+    template <class Criterion>
+    int search(
+            const int &start,
+            const int &end,
+            SearchWorkspace &workspace,
+            const double &limit
+            ) const {
+        /**
+         * Search from every node of start, see settle.
+         * */
+        reset_search(workspace);
+        for(int x = station_node_begin[start];
+                x < station_node_begin[start + 1]; ++x)
+            seed<Criterion>(x, State(0, 0, 0, 0), workspace);
+        return settle<Criterion, false>(end, workspace, limit);
+    }
+
+    bool route_stations(const vector<int> &route, vector<int> &stations) const {
+        /**
+         * Stations a route (its first node, then its arcs) passes, each
+         * once however many lines it changes there. Return false if the
+         * route comes back to a station it has left.
+         * */
+        stations.clear();
+        stations.push_back(node_station[route[0]]);
+        for(size_t i = 1; i < route.size(); ++i)
+            if(node_station[arc_node[route[i]]] != stations.back())
+                stations.push_back(node_station[arc_node[route[i]]]);
+        vector<int> sorted(stations);
+        sort(sorted.begin(), sorted.end());
+        return adjacent_find(sorted.begin(), sorted.end()) == sorted.end();
+    }
+
+    template <class Criterion>
+    void alternatives(
+            const int &start,
+            const int &end,
+            const int &k,
+            SearchWorkspace &workspace,
+            vector<vector<int> > &routes
+            ) const {
+        /**
+         * Yen's algorithm on the line-expanded graph. A route is its first
+         * node followed by its arcs. Every route found is split at each of
+         * its nodes: the part before is kept, the nodes of its stations and
+         * the next arcs of routes found with the same part are blocked, and
+         * a spur search from that node completes a new candidate. Splitting
+         * before the first node lets a candidate start on another line.
+         * Routes passing the same stations as one already returned differ
+         * only in where they change lines, and are left out.
+         * All spur searches share workspace.
+         * */
+        routes.clear();
+        int num_node = node_station.size();
+        vector<vector<int> > found;
+        set<vector<int> > seen, returned;
+        vector<pair<long long, vector<int> > > candidates;
+        std::greater<pair<long long, vector<int> > > heap_cmp;
+        vector<int> stations, spur;
+
+        int target = search<Criterion>(start, end, workspace, INF);
+        if(target == -1) return;
+        vector<int> first;
+        for(int a = workspace.pre[target]; a != -1; a = workspace.pre[arc_from[a]])
+            first.push_back(a);
+        first.push_back(first.empty() ? target : arc_from[first.back()]);
+        reverse(first.begin(), first.end());
+        candidates.push_back(make_pair(Criterion::key(workspace.dist[target]), first));
+        seen.insert(first);
+
+        while(!candidates.empty() && (int) routes.size() < k &&
+                (int) found.size() < k * ALTERNATIVE_MAX_SCAN) {
+            pop_heap(candidates.begin(), candidates.end(), heap_cmp);
+            vector<int> route;
+            route.swap(candidates.back().second);
+            candidates.pop_back();
+            found.push_back(route);
+            if(!route_stations(route, stations)) continue;
+            if(returned.insert(stations).second) routes.push_back(route);
+            if((int) routes.size() >= k) break;
+
+            State label(0, 0, 0, 0);
+            for(int i = -1; i < (int) route.size() - 1; ++i) {
+                int x = i == -1 ? -1 : i == 0 ? route[0] : arc_node[route[i]];
+                if(i > 0) label = relax(label, route[i], *workspace.disruption);
+                reset_search(workspace);
+                workspace.blocked_node.assign(num_node, false);
+                workspace.blocked_arc.assign(arc_node.size(), false);
+                for(int j = 0; j <= i; ++j) {
+                    int u = node_station[j == 0 ? route[0] : arc_node[route[j]]];
+                    if(j == i && i > 0 && arc_edge[route[i]] != -1) break;
+                    for(int y = station_node_begin[u]; y < station_node_begin[u + 1]; ++y)
+                        workspace.blocked_node[y] = true;
+                }
+                for(size_t f = 0; f < found.size(); ++f) {
+                    const vector<int> &other = found[f];
+                    if((int) other.size() <= i + 1 ||
+                            !std::equal(route.begin(), route.begin() + i + 1, other.begin()))
+                        continue;
+                    if(i == -1) workspace.blocked_node[other[0]] = true;
+                    else workspace.blocked_arc[other[i + 1]] = true;
+                }
+                if(i == -1) {
+                    for(int y = station_node_begin[start]; y < station_node_begin[start + 1]; ++y)
+                        if(!workspace.blocked_node[y])
+                            seed<Criterion>(y, State(0, 0, 0, 0), workspace);
+                } else {
+                    workspace.blocked_node[x] = false;
+                    seed<Criterion>(x, label, workspace);
+                }
+
+                int t = settle<Criterion, true>(end, workspace, INF);
+                if(t == -1) continue;
+                spur.clear();
+                for(int a = workspace.pre[t]; a != -1; a = workspace.pre[arc_from[a]])
+                    spur.push_back(a);
+                vector<int> now;
+                if(i == -1) now.push_back(spur.empty() ? t : arc_from[spur.back()]);
+                else now.assign(route.begin(), route.begin() + i + 1);
+                now.insert(now.end(), spur.rbegin(), spur.rend());
+                if(!seen.insert(now).second) continue;
+                candidates.push_back(make_pair(Criterion::key(workspace.dist[t]), now));
+                push_heap(candidates.begin(), candidates.end(), heap_cmp);
+            }
+        }
+    }
+
+    static bool dominates(const State &a, const State &b) {
+        /**
+         * Whether a is at least as good as b on the way to any station.
+         * The fare is a growing function of cost_money and distance, and
+         * stays so along any route, so both are compared in its place.
+         * */
+        return a.cost_time <= b.cost_time && a.interchange <= b.interchange
+            && a.cost_money <= b.cost_money && a.distance <= b.distance;
+    }
+
+    static bool fare_dominates(const State &a, const State &b) {
+        /**
+         * Whether a is at least as good as b on the way to any station for
+         * a money query: the fare only grows with what is paid and with the
+         * distance of the open charge segment, and routes of the same fare
+         * are picked by time and then distance.
+         * */
+        return a.cost_money <= b.cost_money && a.distance <= b.distance &&
+            a.cost_time <= b.cost_time &&
+            a.distance + a.real_distance <= b.distance + b.real_distance;
+    }
+
+    static bool money_before(const State &a, const State &b) {
+        /**
+         * Whether a is a better answer to a money query than b: cheaper,
+         * then faster, then shorter.
+         * */
+        if(a.get_cost() != b.get_cost()) return a.get_cost() < b.get_cost();
+        if(a.cost_time != b.cost_time) return a.cost_time < b.cost_time;
+        return a.distance + a.real_distance < b.distance + b.real_distance;
+    }
+
+    int came_from(const int &arc) const {
+        /**
+         * The station a label reached by arc rode in from, -1 for the
+         * start and interchanges. Labels of fare_search and pareto_search
+         * only beat labels that rode in from the same station: a label that
+         * turned back there could not go on where the other one can
+         * without passing a station twice.
+         * */
+        return arc == -1 || arc_edge[arc] == -1 ? -1 : node_station[arc_from[arc]];
+    }
+
+    void mark_path(const int &l, SearchWorkspace &workspace) const {
+        /**
+         * Mark the stations on the route of label l in workspace.path_stamp.
+         * */
+        vector<unsigned> &stamp = workspace.path_stamp;
+        if((int) stamp.size() != tot_station + 1 || ++workspace.path_generation == 0) {
+            stamp.assign(tot_station + 1, 0);
+            workspace.path_generation = 1;
+        }
+        for(int k = l; k != -1; k = workspace.labels[k].parent)
+            stamp[node_station[workspace.labels[k].node]] = workspace.path_generation;
+    }
+
+    int fare_search(
+            const int &start,
+            const int &end,
+            SearchWorkspace &workspace,
+            const double &limit = INF
+            ) const {
+        /**
+         * Exact cheapest route search. The fare is a step function of the
+         * distance of the open charge segment, and riding a fare-free
+         * line closes it, so a label with a higher fare so far may still
+         * end cheaper and one label per node is not enough. Each node
+         * keeps every label none of its other labels fare_dominates.
+         * Labels are taken by MoneyCriterion::key, whose fare part never
+         * drops along a route, so the first label taken at end has the
+         * lowest fare; labels are taken on until the fare grows, and the
+         * arrival at end first by money_before is returned, -1 if end is
+         * not reachable. A route never passes a station twice, nor changes
+         * lines twice at one station, so that riding a fare-free line
+         * there and back cannot split the fare. With end 0 the whole
+         * network is searched, up to the labels whose fare is over limit.
+         * Labels taken are left in workspace.settled.
+         * */
+        const Disruption &disruption = *workspace.disruption;
+        vector<ParetoLabel> &labels = workspace.labels;
+        vector<vector<int> > &bag = workspace.bag;
+        vector<pair<long long, int> > &heap = workspace.heap;
+        std::greater<pair<long long, int> > heap_cmp;
+        reset_labels(workspace);
+        heap.clear(), workspace.settled.clear();
+
+        for(int x = station_node_begin[start];
+                x < station_node_begin[start + 1]; ++x) {
+            ParetoLabel label;
+            label.state = State(0, 0, 0, 0);
+            label.node = x, label.arc = label.parent = -1, label.dead = false;
+            bag[x].push_back(labels.size());
+            heap.push_back(make_pair(MoneyCriterion::key(label.state), labels.size()));
+            labels.push_back(label);
+            ++workspace.counters.pushed;
+        }
+        make_heap(heap.begin(), heap.end(), heap_cmp);
+
+        int best = -1;
+        while(!heap.empty()) {
+            int l = heap.front().second;
+            pop_heap(heap.begin(), heap.end(), heap_cmp);
+            heap.pop_back();
+            if(labels[l].dead) continue;
+            if(best != -1 && labels[l].state.get_cost() > labels[best].state.get_cost())
+                break;
+            if(labels[l].state.get_cost() > limit) break;
+            workspace.settled.push_back(l);
+            ++workspace.counters.settled;
+            int x = labels[l].node;
+            if(node_station[x] == end) {
+                if(best == -1 || money_before(labels[l].state, labels[best].state))
+                    best = l;
+                continue;
+            }
+            State state = labels[l].state;
+            bool ridden = labels[l].arc != -1 && arc_edge[labels[l].arc] != -1;
+            mark_path(l, workspace);
+            for(int a = arc_begin[x]; a < arc_begin[x + 1]; ++a) {
+                if(disruption.arc_closed[a]) continue;
+                int y = arc_node[a];
+                if(arc_edge[a] == -1 ? !ridden :
+                        workspace.path_stamp[node_station[y]] == workspace.path_generation)
+                    continue;
+                ++workspace.counters.relaxed;
+                State now = relax(state, a, disruption);
+                vector<int> &now_bag = bag[y];
+                int from = came_from(a);
+                bool beaten = false;
+                for(size_t j = 0; j < now_bag.size() && !beaten; ++j)
+                    beaten = came_from(labels[now_bag[j]].arc) == from &&
+                        fare_dominates(labels[now_bag[j]].state, now);
+                if(beaten) continue;
+                size_t kept = 0;
+                for(size_t j = 0; j < now_bag.size(); ++j) {
+                    if(came_from(labels[now_bag[j]].arc) == from &&
+                            fare_dominates(now, labels[now_bag[j]].state))
+                        labels[now_bag[j]].dead = true;
+                    else now_bag[kept++] = now_bag[j];
+                }
+                if(kept > 0) ++workspace.counters.repushed;
+                ++workspace.counters.pushed;
+                now_bag.resize(kept);
+
+                ParetoLabel label;
+                label.state = now;
+                label.node = y, label.arc = a, label.parent = l;
+                label.dead = false;
+                now_bag.push_back(labels.size());
+                heap.push_back(make_pair(MoneyCriterion::key(now), labels.size()));
+                push_heap(heap.begin(), heap.end(), heap_cmp);
+                labels.push_back(label);
+            }
+        }
+        return best;
+    }
+
+    void fare_route(
+            const int &start,
+            const int &end,
+            SearchWorkspace &workspace,
+            Route &ret
+            ) const {
+        /**
+         * Answer a money query by fare_search.
+         * */
+        if(start == end) {
+            ret.clear();
+            return;
+        }
+
+        int best = fare_search(start, end, workspace);
+        vector<int> &arcs = workspace.arcs;
+        arcs.clear();
+        if(best != -1)
+            for(int l = best; workspace.labels[l].parent != -1; l = workspace.labels[l].parent)
+                arcs.push_back(workspace.labels[l].arc);
+        reverse(arcs.begin(), arcs.end());
+        parse_route(best == -1 ? State() : workspace.labels[best].state, arcs,
+                *workspace.disruption, ret);
+    }
+
+    void pareto_search(
+            const int &start,
+            const int &end,
+            SearchWorkspace &workspace
+            ) const {
+        /**
+         * Label-setting search for every route from start to end that no
+         * other route beats on time, fare and interchanges all at once.
+         * Each node keeps a bag of labels none of which dominates another.
+         * Labels are expanded in order of cost_time from buckets, since
+         * times are small integers. A label no better than a route already
+         * found to end, even at its current fare, is dropped. Routes pass
+         * every station once, as in fare_search.
+         * Arrivals at end are left in workspace.settled, with dead ones
+         * being beaten by a later arrival.
+         * */
+        const Disruption &disruption = *workspace.disruption;
+        vector<ParetoLabel> &labels = workspace.labels;
+        vector<vector<int> > &bag = workspace.bag, &bucket = workspace.bucket;
+        vector<int> &found = workspace.settled;
+        reset_labels(workspace);
+        found.clear();
+        for(size_t t = 0; t < bucket.size(); ++t)
+            bucket[t].clear();
+
+        for(int x = station_node_begin[start];
+                x < station_node_begin[start + 1]; ++x) {
+            ParetoLabel label;
+            label.state = State(0, 0, 0, 0);
+            label.node = x, label.arc = label.parent = -1, label.dead = false;
+            bag[x].push_back(labels.size());
+            if(bucket.empty()) bucket.resize(1);
+            bucket[0].push_back(labels.size());
+            labels.push_back(label);
+        }
+        for(size_t t = 0; t < bucket.size(); ++t) {
+            for(size_t i = 0; i < bucket[t].size(); ++i) {
+                int l = bucket[t][i];
+                if(labels[l].dead) continue;
+                int x = labels[l].node;
+                if(node_station[x] == end) continue;
+                bool ridden = labels[l].arc != -1 && arc_edge[labels[l].arc] != -1;
+                mark_path(l, workspace);
+                for(int a = arc_begin[x]; a < arc_begin[x + 1]; ++a) {
+                    if(disruption.arc_closed[a]) continue;
+                    int y = arc_node[a];
+                    if(arc_edge[a] == -1 ? !ridden :
+                            workspace.path_stamp[node_station[y]] == workspace.path_generation)
+                        continue;
+                    State now = relax(labels[l].state, a, disruption);
+                    if(now.cost_time >= INF) continue;
+
+                    bool beaten = false;
+                    int fare = now.get_cost();
+                    for(size_t j = 0; j < found.size() && !beaten; ++j) {
+                        const State &best = labels[found[j]].state;
+                        beaten = !labels[found[j]].dead &&
+                            best.cost_time <= now.cost_time &&
+                            best.get_cost() <= fare &&
+                            best.interchange <= now.interchange;
+                    }
+                    vector<int> &now_bag = bag[y];
+                    int from = came_from(a);
+                    for(size_t j = 0; j < now_bag.size() && !beaten; ++j)
+                        beaten = came_from(labels[now_bag[j]].arc) == from &&
+                            dominates(labels[now_bag[j]].state, now);
+                    if(beaten) continue;
+                    size_t kept = 0;
+                    for(size_t j = 0; j < now_bag.size(); ++j) {
+                        if(came_from(labels[now_bag[j]].arc) == from &&
+                                dominates(now, labels[now_bag[j]].state))
+                            labels[now_bag[j]].dead = true;
+                        else now_bag[kept++] = now_bag[j];
+                    }
+                    now_bag.resize(kept);
+                    if(kept >= PARETO_MAX_LABEL) continue;
+
+                    ParetoLabel label;
+                    label.state = now;
+                    label.node = y, label.arc = a, label.parent = l;
+                    label.dead = false;
+                    now_bag.push_back(labels.size());
+                    if((int) bucket.size() <= now.cost_time)
+                        bucket.resize(now.cost_time + 1);
+                    bucket[now.cost_time].push_back(labels.size());
+                    if(node_station[y] == end) {
+                        for(size_t j = 0; j < found.size(); ++j) {
+                            State &old = labels[found[j]].state;
+                            if(now.cost_time <= old.cost_time &&
+                                    fare <= old.get_cost() &&
+                                    now.interchange <= old.interchange)
+                                labels[found[j]].dead = true;
+                        }
+                        found.push_back(labels.size());
+                    }
+                    labels.push_back(label);
+                }
+            }
+        }
+    }
+
+    int search(
+            const int &criterion,
+            const int &start,
+            const int &end,
+            SearchWorkspace &workspace,
+            const double &limit = INF
+            ) const {
+        /**
+         * Run the search specialized for CRITERION_NAME[criterion].
+         * */
+        switch(criterion) {
+            case CRITERION_DISTANCE:
+                return search<DistanceCriterion>(start, end, workspace, limit);
+            case CRITERION_MONEY:
+                return search<MoneyCriterion>(start, end, workspace, limit);
+            case CRITERION_INTERCHANGE:
+                return search<InterchangeCriterion>(start, end, workspace, limit);
+            default:
+                return search<TimeCriterion>(start, end, workspace, limit);
+        }
+    }
+
+    int arc_cost(const int &metric, const int &a, const Disruption &disruption) const {
+        /**
+         * Minutes (metric 0) or distance (metric 1) of an arc under
+         * disruption.
+         * */
+        int e = arc_edge[a];
+        if(metric == 0) return e == -1 ? INTERCHANGE_TIME : disruption.edge_time[e];
+        return e == -1 ? 0 : adj_distance[e];
+    }
+
+    int arc_tie(const int &metric, const int &a, const Disruption &disruption) const {
+        /**
+         * What breaks ties of arc_cost, as in TimeCriterion and
+         * DistanceCriterion: interchanges for time, minutes for distance.
+         * */
+        int e = arc_edge[a];
+        if(metric == 0) return e == -1;
+        return e == -1 ? INTERCHANGE_TIME : disruption.edge_time[e];
+    }
+
+    void landmark_sweep(
+            const int &metric,
+            const int &station,
+            const bool &backward,
+            int *dist
+            ) const {
+        /**
+         * Shortest arc_cost from station to every node, or from every node
+         * to station when backward, on the network as loaded.
+         * */
+        int num_node = node_station.size();
+        std::fill(dist, dist + num_node, INT_MAX);
+        vector<pair<int, int> > heap;
+        std::greater<pair<int, int> > heap_cmp;
+        for(int x = station_node_begin[station]; x < station_node_begin[station + 1]; ++x) {
+            dist[x] = 0;
+            heap.push_back(make_pair(0, x));
+        }
+        make_heap(heap.begin(), heap.end(), heap_cmp);
+        while(!heap.empty()) {
+            int d = heap.front().first, x = heap.front().second;
+            pop_heap(heap.begin(), heap.end(), heap_cmp);
+            heap.pop_back();
+            if(d > dist[x]) continue;
+            int begin = backward ? landmarks.rev_begin[x] : arc_begin[x];
+            int end = backward ? landmarks.rev_begin[x + 1] : arc_begin[x + 1];
+            for(int i = begin; i < end; ++i) {
+                int a = backward ? landmarks.rev_arc[i] : i;
+                int y = backward ? arc_from[a] : arc_node[a];
+                if(d + arc_cost(metric, a, loaded) < dist[y]) {
+                    dist[y] = d + arc_cost(metric, a, loaded);
+                    heap.push_back(make_pair(dist[y], y));
+                    push_heap(heap.begin(), heap.end(), heap_cmp);
+                }
+            }
+        }
+    }
+
+    int potential(const int &metric, const int &x, SearchWorkspace &workspace) const {
+        /**
+         * Lower bound on the rest of the route from node x to the end minus
+         * lower bound on the route from the start to x, by the triangle
+         * inequality through each landmark. Workspace.bound holds, for each
+         * landmark, the largest distance from a node of the end to it, the
+         * smallest from it to a node of the end, the smallest from a node
+         * of the start to it and the largest from it to a node of the start.
+         * */
+        int &ret = workspace.potential[x];
+        if(workspace.potential_stamp[x] == workspace.generation) return ret;
+        workspace.potential_stamp[x] = workspace.generation;
+        int num_node = node_station.size(), to_end = 0, from_start = 0;
+        const vector<int> &to = landmarks.to[metric], &from = landmarks.from[metric];
+        for(int l = 0; l < (int) landmarks.landmark.size(); ++l) {
+            const int *b = &workspace.bound[l * 4];
+            int x_to = to[l * num_node + x], x_from = from[l * num_node + x];
+            if(x_to != INT_MAX && b[0] != INT_MAX)
+                to_end = max(to_end, x_to - b[0]);
+            if(x_from != INT_MAX && b[1] != INT_MAX)
+                to_end = max(to_end, b[1] - x_from);
+            if(x_to != INT_MAX && b[2] != INT_MAX)
+                from_start = max(from_start, b[2] - x_to);
+            if(x_from != INT_MAX && b[3] != INT_MAX)
+                from_start = max(from_start, x_from - b[3]);
+        }
+        return ret = to_end - from_start;
+    }
+
+    template <class Criterion, int Metric, int Shift>
+    int landmark_search(const int &start, const int &end, SearchWorkspace &workspace) const {
+        /**
+         * Bidirectional A* with landmark bounds, for the time (Metric 0)
+         * and distance (Metric 1) criteria. Both halves use the average of
+         * the forward and backward potentials, so the reduced arc costs are
+         * the same in both directions and the search can stop once the two
+         * smallest keys add up to the best route met. Costs are doubled to
+         * keep the average whole; keys pack them above Shift bits of the
+         * tie breaker, as Criterion does.
+         * Return the node where the halves of the best route meet, -1 if
+         * end is not reachable.
+         * */
+        int num_node = node_station.size();
+        const Disruption &disruption = *workspace.disruption;
+        reset_search(workspace);
+        vector<long long> &key = workspace.key, &back_key = workspace.back_key;
+        vector<int> &pre = workspace.pre, &back_pre = workspace.back_pre;
+        vector<bool> &done = workspace.done, &back_done = workspace.back_done;
+        vector<pair<long long, int> > &heap = workspace.heap, &back_heap = workspace.back_heap;
+        std::greater<pair<long long, int> > heap_cmp;
+        back_heap.clear();
+
+        const vector<int> &to = landmarks.to[Metric], &from = landmarks.from[Metric];
+        int num_landmark = landmarks.landmark.size();
+        workspace.bound.resize(num_landmark * 4);
+        for(int l = 0; l < num_landmark; ++l) {
+            int *b = &workspace.bound[l * 4];
+            b[0] = b[3] = INT_MIN, b[1] = b[2] = INT_MAX;
+            for(int x = station_node_begin[end]; x < station_node_begin[end + 1]; ++x) {
+                b[0] = max(b[0], to[l * num_node + x]);
+                b[1] = min(b[1], from[l * num_node + x]);
+            }
+            for(int x = station_node_begin[start]; x < station_node_begin[start + 1]; ++x) {
+                b[2] = min(b[2], to[l * num_node + x]);
+                b[3] = max(b[3], from[l * num_node + x]);
+            }
+        }
+
+        const long long unit = 1LL << Shift;
+        for(int x = station_node_begin[start]; x < station_node_begin[start + 1]; ++x) {
+            workspace.reach(x);
+            key[x] = potential(Metric, x, workspace) * unit;
+            heap.push_back(make_pair(key[x], x));
+            ++workspace.counters.pushed;
+        }
+        for(int x = station_node_begin[end]; x < station_node_begin[end + 1]; ++x) {
+            workspace.reach_back(x);
+            back_key[x] = -potential(Metric, x, workspace) * unit;
+            back_heap.push_back(make_pair(back_key[x], x));
+            ++workspace.counters.pushed;
+        }
+        make_heap(heap.begin(), heap.end(), heap_cmp);
+        make_heap(back_heap.begin(), back_heap.end(), heap_cmp);
+
+        long long best = LLONG_MAX;
+        int meet = -1;
+        while(true) {
+            while(!heap.empty() && done[heap.front().second]) {
+                pop_heap(heap.begin(), heap.end(), heap_cmp);
+                heap.pop_back();
+            }
+            while(!back_heap.empty() && back_done[back_heap.front().second]) {
+                pop_heap(back_heap.begin(), back_heap.end(), heap_cmp);
+                back_heap.pop_back();
+            }
+            if(heap.empty() || back_heap.empty()) break;
+            if(heap.front().first + back_heap.front().first >= best) break;
+
+            bool forward = heap.front().first <= back_heap.front().first;
+            vector<pair<long long, int> > &now_heap = forward ? heap : back_heap;
+            int x = now_heap.front().second;
+            pop_heap(now_heap.begin(), now_heap.end(), heap_cmp);
+            now_heap.pop_back();
+            (forward ? done : back_done)[x] = true;
+            workspace.settled.push_back(x);
+            ++workspace.counters.settled;
+            int phi = potential(Metric, x, workspace);
+
+            int begin = forward ? arc_begin[x] : landmarks.rev_begin[x];
+            int last = forward ? arc_begin[x + 1] : landmarks.rev_begin[x + 1];
+            for(int i = begin; i < last; ++i) {
+                int a = forward ? i : landmarks.rev_arc[i];
+                int y = forward ? arc_node[a] : arc_from[a];
+                if(disruption.arc_closed[a]) continue;
+                ++workspace.counters.relaxed;
+                workspace.reach(y), workspace.reach_back(y);
+                if(forward ? done[y] : back_done[y]) continue;
+                long long step = 2LL * arc_cost(Metric, a, disruption);
+                int phi_y = potential(Metric, y, workspace);
+                step += forward ? phi_y - phi : phi - phi_y;
+                long long now = (forward ? key[x] : back_key[x]) +
+                    step * unit + arc_tie(Metric, a, disruption);
+                long long &now_key = forward ? key[y] : back_key[y];
+                if(now >= now_key) continue;
+                if(now_key != LLONG_MAX) ++workspace.counters.repushed;
+                ++workspace.counters.pushed;
+                now_key = now;
+                (forward ? pre : back_pre)[y] = a;
+                now_heap.push_back(make_pair(now, y));
+                push_heap(now_heap.begin(), now_heap.end(), heap_cmp);
+                long long other = forward ? back_key[y] : key[y];
+                if(other != LLONG_MAX && now + other < best)
+                    best = now + other, meet = y;
+            }
+        }
+        return meet;
+    }
+
+    void landmark_route(
+            const int &start,
+            const int &end,
+            const int &criterion,
+            SearchWorkspace &workspace,
+            Route &ret
+            ) const {
+        /**
+         * Answer a time or distance query by the landmark search.
+         * */
+        if(start == end) {
+            ret.clear();
+            return;
+        }
+
+        int meet = criterion == CRITERION_TIME ?
+            landmark_search<TimeCriterion, 0, 32>(start, end, workspace) :
+            landmark_search<DistanceCriterion, 1, 24>(start, end, workspace);
+        vector<int> &arcs = workspace.arcs;
+        arcs.clear();
+        if(meet != -1) {
+            for(int a = workspace.pre[meet]; a != -1; a = workspace.pre[arc_from[a]])
+                arcs.push_back(a);
+            reverse(arcs.begin(), arcs.end());
+            for(int a = workspace.back_pre[meet]; a != -1;
+                    a = workspace.back_pre[arc_node[a]])
+                arcs.push_back(a);
+        }
+        State label(0, 0, 0, 0);
+        for(size_t i = 0; i < arcs.size(); ++i)
+            label = relax(label, arcs[i], *workspace.disruption);
+        parse_route(arcs.empty() ? State() : label, arcs, *workspace.disruption, ret);
+    }
+
+    void hierarchy_weights(const int &metric, vector<long long> &weight) const {
+        /**
+         * Weight of every arc for the hierarchy of metric: arc_cost above
+         * arc_tie on the network as loaded, packed as the key of
+         * TimeCriterion or DistanceCriterion so that adding weights adds
+         * keys.
+         * */
+        int shift = metric == 0 ? 32 : 24;
+        weight.resize(arc_node.size());
+        for(int a = 0; a < (int) arc_node.size(); ++a)
+            weight[a] = ((long long) arc_cost(metric, a, loaded) << shift) +
+                arc_tie(metric, a, loaded);
+    }
+
+    unsigned long long hierarchy_fingerprint() const {
+        /**
+         * Checksum of the line-expanded graph and the weights of its arcs,
+         * stored with a saved hierarchy to tell which network it is for.
+         * */
+        vector<long long> data(1, node_station.size()), weight;
+        for(int m = 0; m < 2; ++m) {
+            hierarchy_weights(m, weight);
+            data.insert(data.end(), weight.begin(), weight.end());
+        }
+        for(int a = 0; a < (int) arc_node.size(); ++a)
+            data.push_back(((long long) arc_from[a] << 32) | arc_node[a]);
+        return snapshot_checksum((const char *) &data[0], data.size() * sizeof(long long));
+    }
+
+    void hierarchy_route(
+            const int &start,
+            const int &end,
+            const int &criterion,
+            SearchWorkspace &workspace,
+            Route &ret
+            ) const {
+        /**
+         * Answer a time or distance query by the contraction hierarchy,
+         * unpacking its shortcuts back into the arcs of the route.
+         * */
+        if(start == end) {
+            ret.clear();
+            return;
+        }
+
+        const ContractionHierarchy &ch = hierarchy[criterion == CRITERION_TIME ? 0 : 1];
+        long long best;
+        int meet = ch.search(
+                station_node_begin[start], station_node_begin[start + 1],
+                station_node_begin[end], station_node_begin[end + 1],
+                workspace.upward, best
+            );
+        HierarchyWorkspace &upward = workspace.upward;
+        workspace.counters.settled += upward.settled;
+        workspace.counters.relaxed += upward.relaxed;
+        workspace.counters.pushed += upward.pushed;
+        workspace.counters.repushed += upward.repushed;
+        upward.settled = upward.relaxed = upward.pushed = upward.repushed = 0;
+        vector<int> &arcs = workspace.arcs;
+        arcs.clear();
+        if(meet != -1) ch.unpack_route(meet, workspace.upward, arcs);
+        State label(0, 0, 0, 0);
+        for(size_t i = 0; i < arcs.size(); ++i)
+            label = relax(label, arcs[i], *workspace.disruption);
+        parse_route(arcs.empty() ? State() : label, arcs, *workspace.disruption, ret);
+    }
+
+    void dijkstra(
+            const int &start,
+            const int &end,
+            const int &criterion,
+            SearchWorkspace &workspace,
+            Route &ret
+            ) const {
+        /**
+         * Answer a query by searching from start until end is settled.
+         * */
+        if(start == end) {
+            ret.clear();
+            return;
+        }
+
+        int target = search(criterion, start, end, workspace);
+        vector<int> &arcs = workspace.arcs;
+        arcs.clear();
+        if(target != -1)
+            for(int a = workspace.pre[target]; a != -1;
+                    a = workspace.pre[arc_from[a]])
+                arcs.push_back(a);
+        reverse(arcs.begin(), arcs.end());
+
+        parse_route(target == -1 ? State() : workspace.dist[target], arcs,
+                *workspace.disruption, ret);
+    }
+
+    void fill_route_table(
+            RouteTable &table,
+            const int &criterion,
+            const int &start,
+            SearchWorkspace &workspace
+            ) const {
+        /**
+         * Search the whole network from start and record its row of table.
+         * For money, pairs whose route in the tree is not the one
+         * fare_search answers are left to be searched.
+         * */
+        int num_node = node_station.size();
+        search(criterion, start, 0, workspace);
+        const vector<State> &dist = workspace.dist;
+        const vector<int> &pre = workspace.pre;
+        for(int x = 0; x < num_node; ++x)
+            table.pre[(size_t) start * num_node + x] =
+                !workspace.reached(x) || pre[x] == -1 ? NO_ENTRY : pre[x];
+        for(int i = 0; i < (int) workspace.settled.size(); ++i) {
+            int best = workspace.settled[i], t = node_station[best];
+            size_t k = (size_t) start * (tot_station + 1) + t;
+            if(table.target[k] != NO_ENTRY) continue;
+            table.target[k] = best;
+            table.money[k] = dist[best].get_cost();
+            table.cost_time[k] = dist[best].cost_time;
+            table.distance[k] = dist[best].distance + dist[best].real_distance;
+        }
+        if(criterion != CRITERION_MONEY) return;
+
+        fare_search(start, 0, workspace);
+        vector<State> best(tot_station + 1);
+        vector<bool> found(tot_station + 1, false);
+        for(size_t i = 0; i < workspace.settled.size(); ++i) {
+            const ParetoLabel &label = workspace.labels[workspace.settled[i]];
+            int t = node_station[label.node];
+            if(!found[t] || money_before(label.state, best[t]))
+                best[t] = label.state, found[t] = true;
+        }
+        for(int t = 1; t <= tot_station; ++t) {
+            size_t k = (size_t) start * (tot_station + 1) + t;
+            if(table.target[k] != NO_ENTRY && (!found[t] ||
+                        money_before(best[t], dist[table.target[k]]) ||
+                        money_before(dist[table.target[k]], best[t])))
+                table.target[k] = SEARCH_ENTRY;
+        }
+    }
+
+    ThreadPool &get_pool() const {
+        /**
+         * The worker threads, one per hardware thread.
+         * */
+        return *batch_pool;
+    }
+
+    void lookup_route(
+            const RouteTable &table,
+            const int &start,
+            const int &end,
+            SearchWorkspace &workspace,
+            Route &ret
+            ) const {
+        /**
+         * Answer a query from the precomputed table.
+         * */
+        if(start == end) {
+            ret.clear();
+            return;
+        }
+
+        size_t num_node = node_station.size(), k = (size_t) start * (tot_station + 1) + end;
+        vector<int> &arcs = workspace.arcs;
+        arcs.clear();
+        if(table.target[k] != NO_ENTRY && table.target[k] != SEARCH_ENTRY)
+            for(int a = table.pre[start * num_node + table.target[k]];
+                    a != NO_ENTRY; a = table.pre[start * num_node + arc_from[a]])
+                arcs.push_back(a);
+        reverse(arcs.begin(), arcs.end());
+
+        parse_route(State(), arcs, *workspace.disruption, ret);
+        if(!arcs.empty()) {
+            ret.money = table.money[k];
+            ret.cost_time = table.cost_time[k];
+            ret.distance = (double) table.distance[k] / DISTANCE_UNIT;
+        }
+    }
+
+    void add_tree_station(ShortestPathTree &tree, const int &t, const State &state) const {
+        /**
+         * Record the route to t, of label state, in tree. The route from
+         * start to itself rides nothing and pays nothing, as query answers,
+         * although its label already prices the charge segment it is about
+         * to open.
+         * */
+        tree.stations.push_back(t);
+        tree.money[t] = t == tree.start ? 0 : state.get_cost();
+        tree.cost_time[t] = state.cost_time;
+        tree.interchange[t] = state.interchange;
+        tree.distance[t] = state.get_distance();
+        for(int e = tree.target[t]; tree.pre[e] != -1; e = tree.parent[e])
+            if(arc_edge[tree.pre[e]] != -1) {
+                tree.pre_station[t] = node_station[arc_from[tree.pre[e]]];
+                break;
+            }
+    }
+
+    ShortestPathTree build_tree(
+            const int &start,
+            const int &criterion,
+            const double &limit
+            ) const {
+        /**
+         * Search from start once and collect the route to every station
+         * settled within limit. Money is searched by fare_search, so that
+         * every route is the one query answers.
+         * */
+        ShortestPathTree ret;
+        ret.start = start;
+        ret.money.assign(tot_station + 1, INF);
+        ret.cost_time.assign(tot_station + 1, INF);
+        ret.interchange.assign(tot_station + 1, INF);
+        ret.pre_station.assign(tot_station + 1, 0);
+        ret.distance.assign(tot_station + 1, INF);
+        ret.target.assign(tot_station + 1, -1);
+        if(start < 1 || start > tot_station) return ret;
+
+        SearchWorkspace &workspace = thread_workspace();
+        RcuPointer<const Disruption>::Guard disruption(disruptions);
+        workspace.disruption = disruption.get();
+        const vector<int> &settled = workspace.settled;
+        if(criterion == CRITERION_MONEY) {
+            fare_search(start, 0, workspace, limit);
+            const vector<ParetoLabel> &labels = workspace.labels;
+            ret.pre.resize(labels.size());
+            ret.parent.resize(labels.size());
+            for(size_t l = 0; l < labels.size(); ++l)
+                ret.pre[l] = labels[l].arc, ret.parent[l] = labels[l].parent;
+            for(size_t i = 0; i < settled.size(); ++i) {
+                int l = settled[i], t = node_station[labels[l].node];
+                if(ret.target[t] == -1 ||
+                        money_before(labels[l].state, labels[ret.target[t]].state))
+                    ret.target[t] = l;
+            }
+            for(size_t i = 0; i < settled.size(); ++i) {
+                int l = settled[i], t = node_station[labels[l].node];
+                if(ret.target[t] == l) add_tree_station(ret, t, labels[l].state);
+            }
+            return ret;
+        }
+
+        search(criterion, start, 0, workspace, limit);
+        ret.pre.assign(node_station.size(), -1);
+        ret.parent.assign(node_station.size(), -1);
+        for(size_t i = 0; i < settled.size(); ++i) {
+            int x = settled[i], a = workspace.pre[x];
+            ret.pre[x] = a, ret.parent[x] = a == -1 ? -1 : arc_from[a];
+        }
+        for(size_t i = 0; i < settled.size(); ++i) {
+            int x = settled[i], t = node_station[x];
+            if(ret.target[t] != -1) continue;
+            ret.target[t] = x;
+            add_tree_station(ret, t, workspace.dist[x]);
+        }
+        return ret;
+    }
+
+    int find_route(
+            const int &start,
+            const int &end,
+            const int &criterion,
+            SearchWorkspace &workspace,
+            Route &ret
+            ) const {
+        /**
+         * Answer a query of CRITERION_NAME[criterion] from the cache, the
+         * route tables, the contraction hierarchy, the landmark search or a
+         * plain search (fare_search for money), in that order. Routes from
+         * the tables or the hierarchy that cross a disruption are searched
+         * again.
+         * Return the source of ANSWER_SOURCE_NAME that gave the answer, -1
+         * if a station is out of range.
+         * */
+        if(start < 1 || start > tot_station || end < 1 || end > tot_station) {
+            ret.clear();
+            ret.money = ret.cost_time = INF, ret.distance = INF;
+            return -1;
+        }
+
+        long long key =
+            ((long long) start * (tot_station + 1) + end) * NUM_CRITERION + criterion;
+        RcuPointer<const RouteCache<Route> >::Guard cache(route_cache);
+        if(cache.get() != NULL && cache->get(key, ret))
+            return SOURCE_CACHE;
+
+        int source = -1;
+        if(!route_tables.empty()) {
+            const RouteTable &table = route_tables[criterion];
+            lookup_route(table, start, end, workspace, ret);
+            if(table.target[(size_t) start * (tot_station + 1) + end] != SEARCH_ENTRY &&
+                    !crosses_disruption(workspace.arcs, *workspace.disruption))
+                source = SOURCE_TABLE;
+        }
+        if(source == -1 && !hierarchy[0].empty() &&
+                (criterion == CRITERION_TIME || criterion == CRITERION_DISTANCE)) {
+            hierarchy_route(start, end, criterion, workspace, ret);
+            if(!crosses_disruption(workspace.arcs, *workspace.disruption))
+                source = SOURCE_HIERARCHY;
+        }
+        if(source == -1 && !landmarks.landmark.empty() &&
+                (criterion == CRITERION_TIME || criterion == CRITERION_DISTANCE)) {
+            landmark_route(start, end, criterion, workspace, ret);
+            source = SOURCE_LANDMARK;
+        }
+        if(source == -1 && criterion == CRITERION_MONEY)
+            fare_route(start, end, workspace, ret);
+        else if(source == -1)
+            dijkstra(start, end, criterion, workspace, ret);
+        if(cache.get() != NULL)
+            cache->put(key, ret);
+        return source == -1 ? SOURCE_SEARCH : source;
+    }
+
+    void answer(
+            const int &start,
+            const int &end,
+            const int &criterion,
+            SearchWorkspace &workspace,
+            Route &ret
+            ) const {
+        /**
+         * Find_route under the current disruptions, recorded in the query
+         * stats if they are enabled. Safe to call from several threads with
+         * different workspaces. The disruptions are held until the answer
+         * is cached, so that a disruption made meanwhile waits to drop it.
+         * */
+        RcuPointer<const Disruption>::Guard disruption(disruptions);
+        workspace.disruption = disruption.get();
+        if(query_recorder == NULL) {
+            find_route(start, end, criterion, workspace, ret);
+            return;
+        }
+        workspace.counters.clear();
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        int source = find_route(start, end, criterion, workspace, ret);
+        long long nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin).count();
+        if(source != -1)
+            query_recorder->record(criterion, source, start, end,
+                    workspace.counters, ret.station.size(), nanos);
+    }
+
+    static bool crosses_disruption(const vector<int> &arcs, const Disruption &disruption) {
+        /**
+         * Whether a route uses an arc that is closed or slower than loaded.
+         * */
+        if(disruption.num_disrupted == 0) return false;
+        for(size_t i = 0; i < arcs.size(); ++i)
+            if(disruption.arc_disrupted[arcs[i]]) return true;
+        return false;
+    }
 
-    int get_station_index(string &name) {
+    int find_edge(const int &from, const int &to) const {
         /**
-         * Different from query_station_index, it will automatically add the name
-         * to database if this name not exists.
+         * The adjacency edge from station from to station to, -1 if they
+         * are not adjacent.
          * */
-        if(station_name_index.find(name) == station_name_index.end()) {
-            station_name_index[name] = ++tot_station;
-            station_index_name[tot_station] = name;
-        }
-        return station_name_index[name];
+        if(from < 1 || from > tot_station || to < 1 || to > tot_station) return -1;
+        for(int e = adj_begin[from]; e < adj_begin[from + 1]; ++e)
+            if(adj_station[e] == to) return e;
+        return -1;
     }
 
-    string get_subway_on(const Edge &e) {
+    void station_arcs(const int &station, vector<int> &arcs) const {
         /**
-         * Determine which subway line is on.
+         * Append every arc leaving or entering a node of station.
          * */
-        string a = e.start, b = e.end;
-        for(map<string, set<string> >::iterator
-                it = subway_stations.begin();
-                it != subway_stations.end(); ++it) {
-            if(it->second.find(a) == it->second.end()) continue;
-            if(it->second.find(b) == it->second.end()) continue;
-            return it->first;
-        }
-        return "";
+        for(int x = station_node_begin[station]; x < station_node_begin[station + 1]; ++x)
+            for(int a = arc_begin[x]; a < arc_begin[x + 1]; ++a) {
+                arcs.push_back(a);
+                if(arc_edge[a] != -1) arcs.push_back(arc_to(arc_node[a], x));
+            }
     }
 
-    string get_subway_on(string &a, string &b) {
+    int edge_arc(const int &from, const int &e) const {
         /**
-         * Determine which subway line is on.
+         * The arc riding along adjacency edge e, which leaves station from.
          * */
-        for(map<string, set<string> >::iterator
-                it = subway_stations.begin();
-                it != subway_stations.end(); ++it) {
-            if(it->second.find(a) == it->second.end()) continue;
-            if(it->second.find(b) == it->second.end()) continue;
-            return it->first;
-        }
-        return "";
+        return arc_to(node_of(from, adj_subway[e]), node_of(adj_station[e], adj_subway[e]));
     }
 
-    Response parse_response(
-            map<string, State> &dist,
-            string &start,
-            string &end
-            ) {
+    Disruption *copy_disruptions() const {
         /**
-         * Parse a response structure to response query using the information
-         * recorded by shortest-path algorithm.
+         * A copy of the current disruptions for a disruption to change,
+         * with disruption_lock held.
          * */
+        RcuPointer<const Disruption>::Guard current(disruptions);
+        return new Disruption(*current.get());
+    }
 
-        Response ret;
-        int &money = ret.money, &cost_time = ret.cost_time;
-        double &distance = ret.distance;
-        vector<pair<string, vector<string> > > &path = ret.path;
-        vector<int> &time_between_station = ret.time_between_station;
-        if(dist.find(end) == dist.end()) {
-            money = cost_time = INF, distance = INF;
-            path.clear(), time_between_station.clear();
-        } else {
-            money = dist[end].get_cost();
-            cost_time = dist[end].cost_time;
-            distance = dist[end].get_distance();
-
-            string pre_subway = "", pre_station = end;
-            vector<string> pass;
-            pass.push_back(end);
-            while(pre_station != start) {
-                State pre = dist[pre_station];
-                string now_station = pre.pre_station;
-                State now = dist[now_station];
-                string now_subway = get_subway_on(now_station, pre_station);
-                if(now_subway != pre_subway && pre_subway != "") {
-                    if(pass.size()) {
-                        reverse(pass.begin(), pass.end());
-                        path.push_back(make_pair(pre_subway, pass));
-                        pass.clear();
-                    }
-                    pass.push_back(pre_station);
-                }
+    bool set_station(const int &station, const bool &closed) {
+        /**
+         * Close or reopen station. Return false if there is no such station.
+         * */
+        if(station < 1 || station > tot_station) return false;
+        std::lock_guard<std::mutex> guard(disruption_lock);
+        Disruption *next = copy_disruptions();
+        next->station_closed[station] = closed;
+        vector<int> arcs;
+        station_arcs(station, arcs);
+        disrupt(next, arcs);
+        return true;
+    }
 
-                pass.push_back(now_station);
-                time_between_station.push_back(
-                        pre.cost_time - now.cost_time
-                    );
+    bool set_section(const int &from, const int &to, const int &closed, const int &delay) {
+        /**
+         * Set whether the section between stations from and to is closed,
+         * unless closed is -1, and its delay, unless delay is -1, both
+         * ways. Return false if the stations are not adjacent.
+         * */
+        int e = find_edge(from, to), back = find_edge(to, from);
+        if(e == -1 || back == -1) return false;
+        std::lock_guard<std::mutex> guard(disruption_lock);
+        Disruption *next = copy_disruptions();
+        if(closed != -1) next->edge_closed[e] = next->edge_closed[back] = closed;
+        if(delay != -1) next->edge_delay[e] = next->edge_delay[back] = delay;
+        vector<int> arcs;
+        arcs.push_back(edge_arc(from, e));
+        arcs.push_back(edge_arc(to, back));
+        disrupt(next, arcs);
+        return true;
+    }
 
-                pre_station = now_station, pre_subway = now_subway;
+    void disrupt(Disruption *next, const vector<int> &arcs) {
+        /**
+         * Bring arcs of next, a copy of the current disruptions, in line
+         * with its station_closed, edge_closed and edge_delay, and publish
+         * it, which waits for the queries still reading the current one.
+         * Then cached answers crossing an arc that got worse are dropped;
+         * if any got better, every cached answer is. Route tables,
+         * landmarks and hierarchies are never rebuilt, see loaded.
+         * */
+        set<int> stations;
+        set<pair<int, int> > sections;
+        bool better = false, slowed = false;
+        for(size_t i = 0; i < arcs.size(); ++i) {
+            int a = arcs[i], e = arc_edge[a];
+            int u = node_station[arc_from[a]], v = node_station[arc_node[a]];
+            bool closed = next->station_closed[u] || next->station_closed[v] ||
+                (e != -1 && next->edge_closed[e]);
+            int time = e == -1 ? 0 : adj_time[e] + next->edge_delay[e];
+            int old_time = e == -1 ? 0 : next->edge_time[e];
+            bool worse = closed ? !next->arc_closed[a] : time > old_time;
+            better = better || (!closed && (next->arc_closed[a] || time < old_time));
+            if(worse && e == -1) stations.insert(u);
+            else if(worse) sections.insert(make_pair(u, v));
 
-                if(pre_station == start && pass.size()) {
-                    reverse(pass.begin(), pass.end());
-                    path.push_back(make_pair(now_subway, pass));
-                    pass.clear();
-                }
-            }
-            reverse(time_between_station.begin(), time_between_station.end());
-            reverse(path.begin(), path.end());
+            if(time != old_time) next->edge_time[e] = time, slowed = true;
+            next->arc_closed[a] = closed;
+            bool disrupted = closed || (e != -1 && next->edge_delay[e] > 0);
+            next->num_disrupted += (int) disrupted - (int) next->arc_disrupted[a];
+            next->arc_disrupted[a] = disrupted;
         }
-        return ret;
+        if(slowed) update_delays(*next);
+        disruptions.publish(next);
+
+        RcuPointer<const RouteCache<Route> >::Guard cache(route_cache);
+        if(cache.get() != NULL && better)
+            cache->clear();
+        else if(cache.get() != NULL && !(stations.empty() && sections.empty()))
+            cache->erase_if([this, &stations, &sections](const Route &route) {
+                        return crosses(route, stations, sections);
+                    });
     }
 
-    Response spfa(string &start, string &end, Comp &cmp) {
+    static bool crosses(
+            const Route &route,
+            const set<int> &stations,
+            const set<pair<int, int> > &sections
+            ) {
         /**
-         * Shortest path algorithm.
+         * Whether a route passes one of stations or rides one of sections,
+         * given by their stations in order.
          * */
-        if(start == end) {
-            Response res;
-            return res;
-        }
-
-        map<string, State> dist;
-        queue<string> que;
-        map<string, bool> inque;
-
-        dist[start] = State("", 0, 0, 0, 0.);
-        que.push(start), inque[start] = true;
-        while(!que.empty()) {
-            string u = que.front();
-            que.pop(), inque[u] = false;
-            State pre_state = dist[u];
-            string pre_subway = get_subway_on(pre_state.pre_station, u);
-            for(set<Edge>::iterator
-                    sub = graph[u].begin();
-                    sub != graph[u].end(); ++sub) {
-                Edge e = *sub;
-                string now_subway = get_subway_on(e);
-                State now(u);
-                int &cost_time = now.cost_time,
-                    &cost_money = now.cost_money,
-                    &interchange = now.interchange;
-                double &distance = now.distance, &real_distance = now.real_distance;
-                cost_time = pre_state.cost_time + e.cost_time;
-                distance = pre_state.distance;
-                cost_money = pre_state.cost_money;
-                real_distance = pre_state.real_distance;
-                interchange = pre_state.interchange;
-                if(now_subway != pre_subway && pre_subway != "")
-                    ++interchange, cost_time += 2;
-                if(now_subway != "APM") distance += e.distance;
-                else real_distance += e.distance;
-                if(now_subway != pre_subway && now_subway == "APM") {
-                    cost_money = now.get_cost() - 2;
-                    now.real_distance += now.distance;
-                    now.distance = 0.;
-                }
+        for(int i = 0; i < route.num_segment(); ++i)
+            for(int j = route.segment_begin[i]; j < route.segment_begin[i + 1]; ++j) {
+                int u = route.station[j];
+                if(stations.count(u)) return true;
+                if(j > route.segment_begin[i] &&
+                        sections.count(make_pair(route.station[j - 1], u)))
+                    return true;
+            }
+        return false;
+    }
 
-                State nex = dist[e.end];
-                if(cmp(now, nex)) {
-                    dist[e.end] = now;
-                    if(!inque[e.end])
-                        inque[e.end] = true, que.push(e.end);
-                }
+    void update_delays(Disruption &next) const {
+        /**
+         * Recompute how late trains reach each stop of the timetable under
+         * next.
+         * */
+        for(int r = 0; r < timetable.size(); ++r) {
+            int late = 0;
+            for(int i = timetable.route_stop_begin[r]; i < timetable.route_stop_begin[r + 1]; ++i) {
+                int a = timetable.route_arc[i];
+                if(a != -1) late += next.edge_time[arc_edge[a]] - adj_time[arc_edge[a]];
+                next.route_delay[i] = late;
             }
         }
-
-        Response path = parse_response(dist, start, end);
-        return path;
     }
 
 public :
@@ -401,26 +2549,53 @@ public :
         }
     }
 
-    Metro(const char **subway_name_list, int station_number) {
-        tot_station = 0;
+    Metro(const char **subway_name_list, int station_number) :
+        route_cache(NULL), disruptions(new Disruption()) {
         /**
          * Be careful: pass a data file name list in a array, with
          *             station_number indicates the number of data files
          *             array. Pass subway_name_list with SUBWAY_NAME is
          *             suggested.
          * */
+        batch_pool = new ThreadPool(thread::hardware_concurrency());
+        data_directory = "data";
+        load(subway_name_list, station_number);
+    }
+
+    Metro(const string &snapshot_filename) :
+        route_cache(NULL), disruptions(new Disruption()) {
+        /**
+         * Load the network from a snapshot file written by save_snapshot.
+         * If the file is not a valid snapshot, the network is left empty.
+         * */
+        batch_pool = new ThreadPool(thread::hardware_concurrency());
+        data_directory = "data";
+        tot_station = tot_subway = 0;
+        if(!load_snapshot(snapshot_filename))
+            cout << snapshot_filename << " is not a valid snapshot." << endl;
+    }
+
+    ~Metro() {
+        delete batch_pool;
+    }
 
+    void load(const char **subway_name_list, int station_number) {
+        /**
+         * (Re)load the network from the data files, the same way as the
+         * constructor. Cached answers are dropped and route tables are
+         * recomputed if they were built before.
+         * */
+        map<string, int> station_name_index;
+        vector<string> station_index_name(1);
+        map<string, set<string> > subway_stations;
+        map<string, set<Edge> > graph;
         for(int i = 0; i < station_number; ++i) {
             const string subway_name(subway_name_list[i]);
             vector<pair<string, int> > station_time;
             vector<pair<string, double> > station_distance;
-            #ifdef WIN32
-            read_data("data\\" + subway_name + ".txt", station_time, station_distance);
-            #else
-            read_data("data/" + subway_name + ".txt", station_time, station_distance);
-            #endif
+            read_data(data_file(subway_name + ".txt"), station_time, station_distance);
 
-            if(station_time.size() != station_distance.size()) {
+            if(station_time.empty() || station_time.size() != station_distance.size()) {
                 cout << subway_name << " data format is not valid." << endl;
                 continue;
             }
@@ -433,64 +2608,749 @@ public :
             for(vector<pair<string, int> >::iterator it = station_time.begin();
                     it != station_time.end();
                     ++it)
-                subway_contain.insert(it->first),
-                station_belong[it->first].insert(subway_name);
+                subway_contain.insert(it->first);
             for(int i = 0; i < num_station - 1; ++i) {
                 string start = station_time[i].first,
                        end = station_time[i + 1].first;
                 int time_delta =
                     station_time[i + 1].second - station_time[i].second;
                 double distance = station_distance[i].second;
-                graph[start].insert(Edge(start, end, time_delta, distance));
-                graph[end].insert(Edge(end, start, time_delta, distance));
+                graph[start].insert(
+                        Edge(start, end, subway_name, time_delta, distance)
+                    );
+                graph[end].insert(
+                        Edge(end, start, subway_name, time_delta, distance)
+                    );
+
+                get_station_index(station_name_index, station_index_name, start);
+                get_station_index(station_name_index, station_index_name, end);
+            }
+        }
+
+        NetworkArrays data;
+        build_names(data, station_index_name, subway_stations, station_name_index);
+        build_adjacency(data, graph, station_index_name,
+                subway_stations, station_name_index);
+        build_expanded_graph(data);
+        std::swap(network_data, data);
+        bind_network_data();
+        network_changed();
+    }
+
+    bool load_manifest(const string &filename) {
+        /**
+         * (Re)load the network from the lines listed in a manifest file,
+         * one line name per row, read from NAME.txt next to the manifest.
+         * Empty rows and rows starting with '#' are skipped. Return false,
+         * keeping the current network, if the manifest cannot be read.
+         * */
+        ifstream in(filename.c_str());
+        if(!in) return false;
+        vector<string> names;
+        string line_data;
+        while(getline(in, line_data)) {
+            if(!line_data.empty() && line_data[line_data.size() - 1] == '\r')
+                line_data.erase(line_data.size() - 1);
+            if(line_data.empty() || line_data[0] == '#') continue;
+            names.push_back(line_data);
+        }
+        size_t slash = filename.find_last_of("/\\");
+        data_directory = slash == string::npos ? "." : filename.substr(0, slash);
+        vector<const char *> list;
+        for(size_t i = 0; i < names.size(); ++i)
+            list.push_back(names[i].c_str());
+        load(list.empty() ? NULL : &list[0], list.size());
+        return true;
+    }
+
+    bool load_snapshot(const string &filename) {
+        /**
+         * (Re)load the network from a snapshot file written by save_snapshot.
+         * The file is mapped and used in place, nothing is parsed or copied.
+         * Return false, keeping the current network, if the file is missing
+         * or not a valid snapshot.
+         * */
+        SnapshotFile file;
+        if(!file.open(filename)) return false;
+        snapshot.swap(file);
+        if(!bind_snapshot()) {
+            snapshot.swap(file);
+            if(snapshot.empty()) bind_network_data();
+            else bind_snapshot();
+            return false;
+        }
+        network_data = NetworkArrays();
+        network_changed();
+        return true;
+    }
+
+    bool save_snapshot(const string &filename) const {
+        /**
+         * Write the loaded network to filename as a snapshot, which
+         * load_snapshot can map back in, without the disruptions. Return
+         * false if it cannot be written.
+         * */
+        NetworkArrays data;
+#define COPY_ARRAY(type, name) \
+        data.name.assign(name.data, name.data + name.size());
+        NETWORK_ARRAYS(COPY_ARRAY)
+#undef COPY_ARRAY
+        return write_snapshot(filename, data);
+    }
+
+    size_t route_table_bytes() const {
+        /**
+         * Bytes the route tables of all criteria take for this network.
+         * */
+        size_t num_pair = (size_t) (tot_station + 1) * (tot_station + 1);
+        size_t num_pre = (size_t) (tot_station + 1) * node_station.size();
+        return NUM_CRITERION * (num_pair * (3 * sizeof(unsigned short) + sizeof(int)) +
+                num_pre * sizeof(unsigned short));
+    }
+
+    bool precompute_routes() {
+        /**
+         * Fill the route tables of all criteria, so that later queries are
+         * answered by looking up instead of searching. They are built on
+         * the network as loaded, whatever the disruptions.
+         * The sources are searched in parallel on the worker threads. Return
+         * false if the network is too large for the tables, that is its
+         * nodes or arcs do not fit their entries or they would take more
+         * than ROUTE_TABLE_BUDGET bytes.
+         * */
+        int num_node = node_station.size();
+        if(num_node >= SEARCH_ENTRY || (int) arc_node.size() >= NO_ENTRY ||
+                route_table_bytes() > ROUTE_TABLE_BUDGET)
+            return false;
+
+        vector<RouteTable> tables(NUM_CRITERION);
+        size_t num_pair = (size_t) (tot_station + 1) * (tot_station + 1);
+        for(int c = 0; c < NUM_CRITERION; ++c) {
+            tables[c].target.assign(num_pair, NO_ENTRY);
+            tables[c].money.assign(num_pair, 0);
+            tables[c].cost_time.assign(num_pair, 0);
+            tables[c].distance.assign(num_pair, 0);
+            tables[c].pre.assign((size_t) (tot_station + 1) * num_node, NO_ENTRY);
+        }
+
+        get_pool().run(NUM_CRITERION * tot_station,
+                [this, &tables](int task, int) {
+                    int c = task / tot_station, s = task % tot_station + 1;
+                    SearchWorkspace &workspace = thread_workspace();
+                    workspace.disruption = &loaded;
+                    fill_route_table(tables[c], c, s, workspace);
+                });
+
+        route_tables.swap(tables);
+        return true;
+    }
+
+    void precompute_landmarks(const int &num_landmark = NUM_LANDMARK) {
+        /**
+         * Pick num_landmark landmark stations and store the time and
+         * distance between them and every node, so that time and distance
+         * queries not answered by route tables run a bidirectional A*
+         * search that mostly settles nodes between the start and the end.
+         * Each landmark is the station farthest in time from those picked
+         * before, starting from the one farthest from station 1.
+         * */
+        LandmarkIndex index;
+        landmarks.landmark.clear();
+        int num_node = node_station.size();
+        if(tot_station < 1 || num_landmark < 1) {
+            landmarks = index;
+            return;
+        }
+
+        index.rev_begin.assign(num_node + 1, 0);
+        for(int a = 0; a < (int) arc_node.size(); ++a)
+            ++index.rev_begin[arc_node[a] + 1];
+        for(int x = 0; x < num_node; ++x)
+            index.rev_begin[x + 1] += index.rev_begin[x];
+        vector<int> next(index.rev_begin.begin(), index.rev_begin.end() - 1);
+        index.rev_arc.assign(arc_node.size(), 0);
+        for(int a = 0; a < (int) arc_node.size(); ++a)
+            index.rev_arc[next[arc_node[a]]++] = a;
+        landmarks.rev_begin.swap(index.rev_begin);
+        landmarks.rev_arc.swap(index.rev_arc);
 
-                get_station_index(start);
-                get_station_index(end);
+        int num = min(num_landmark, tot_station);
+        for(int m = 0; m < 2; ++m) {
+            landmarks.to[m].assign((long long) num * num_node, INT_MAX);
+            landmarks.from[m].assign((long long) num * num_node, INT_MAX);
+        }
+        vector<int> nearest(tot_station + 1, INT_MAX), dist(num_node);
+        landmark_sweep(0, 1, false, &dist[0]);
+        for(int l = 0; l < num; ++l) {
+            int pick = -1, far = -1;
+            for(int x = 0; x < num_node; ++x) {
+                int u = node_station[x];
+                int d = l == 0 ? dist[x] : nearest[u];
+                if(d != INT_MAX && d > far && nearest[u] != 0) pick = u, far = d;
+            }
+            if(pick == -1) break;
+            landmarks.landmark.push_back(pick);
+            for(int m = 0; m < 2; ++m) {
+                landmark_sweep(m, pick, true, &landmarks.to[m][(long long) l * num_node]);
+                landmark_sweep(m, pick, false, &landmarks.from[m][(long long) l * num_node]);
             }
+            const int *time = &landmarks.from[0][(long long) l * num_node];
+            for(int x = 0; x < num_node; ++x)
+                nearest[node_station[x]] = min(nearest[node_station[x]], time[x]);
         }
+        int picked = landmarks.landmark.size();
+        for(int m = 0; m < 2; ++m) {
+            landmarks.to[m].resize((long long) picked * num_node);
+            landmarks.from[m].resize((long long) picked * num_node);
+        }
+        clear_cache();
+    }
+
+    void precompute_hierarchy() {
+        /**
+         * Build the contraction hierarchies of the time and distance
+         * criteria, interchange arcs and their penalty included, so that
+         * those queries not answered by route tables search only a few
+         * nodes upward from each end. Unlike route tables they stay small
+         * on large networks.
+         * */
+        int num_node = node_station.size(), num_arc = arc_node.size();
+        vector<ContractionHierarchy> built(2);
+        ThreadPool &pool = get_pool();
+        pool.run(2, [this, &built, num_node, num_arc](int m, int) {
+                    vector<long long> weight;
+                    hierarchy_weights(m, weight);
+                    built[m].build(num_node, num_arc, arc_from.data, arc_node.data,
+                            weight.empty() ? NULL : &weight[0]);
+                });
+        for(int m = 0; m < 2; ++m)
+            std::swap(hierarchy[m], built[m]);
+        clear_cache();
+    }
+
+    bool save_hierarchy(const string &filename) const {
+        /**
+         * Write the contraction hierarchies to filename, so that
+         * load_hierarchy can skip building them. Return false if they are
+         * not built or the file cannot be written.
+         * */
+        if(hierarchy[0].empty()) return false;
+        vector<ContractionHierarchy> list(hierarchy, hierarchy + 2);
+        return write_hierarchy(filename, list, hierarchy_fingerprint());
+    }
+
+    bool load_hierarchy(const string &filename) {
+        /**
+         * Read contraction hierarchies written by save_hierarchy. Return
+         * false, keeping the current ones, if the file is missing, damaged
+         * or was saved for another network.
+         * */
+        vector<ContractionHierarchy> list(2);
+        if(!read_hierarchy(filename, list, hierarchy_fingerprint())) return false;
+        for(int m = 0; m < 2; ++m)
+            if(!list[m].valid(node_station.size(), arc_node.size())) return false;
+        for(int m = 0; m < 2; ++m)
+            std::swap(hierarchy[m], list[m]);
+        clear_cache();
+        return true;
+    }
+
+    bool close_station(const int &station) {
+        /**
+         * Close a station: no route starts, ends, changes lines or passes
+         * there until it is reopened. Return false if there is no such
+         * station.
+         * Disruptions may run while queries do. Each changes a copy of
+         * the disruptions and swaps it in once no query still reads the
+         * old one, so a query sees either all of a disruption or none of
+         * it. Only cached answers through the station are dropped, and
+         * precomputed routes through it are searched again when asked for;
+         * reopening rebuilds nothing. A disruption may also be made from a
+         * thread that is answering a query, such as a request handler.
+         * Queries read the disruptions through an RcuPointer, so at most
+         * RCU_MAX_READER running threads may have queried any Metro; one
+         * more aborts instead of waiting.
+         * */
+        return set_station(station, true);
+    }
+
+    bool reopen_station(const int &station) {
+        return set_station(station, false);
+    }
+
+    bool close_section(const int &from, const int &to) {
+        /**
+         * Close the section between adjacent stations from and to, both
+         * ways. Return false if they are not adjacent. See close_station.
+         * */
+        return set_section(from, to, true, -1);
+    }
+
+    bool reopen_section(const int &from, const int &to) {
+        return set_section(from, to, false, -1);
+    }
+
+    bool slow_section(const int &from, const int &to, const int &minutes) {
+        /**
+         * Make riding between adjacent stations from and to take minutes
+         * more than loaded, both ways; 0 lifts the delay. Timetabled trains
+         * reach every later stop that much late. Return false if they are
+         * not adjacent or minutes is negative. See close_station.
+         * */
+        if(minutes < 0) return false;
+        return set_section(from, to, -1, minutes);
+    }
+
+    void clear_disruptions() {
+        /**
+         * Reopen every station and section at its loaded time.
+         * */
+        std::lock_guard<std::mutex> guard(disruption_lock);
+        Disruption *next = copy_disruptions();
+        vector<int> arcs;
+        for(int a = 0; a < (int) arc_node.size(); ++a)
+            if(next->arc_disrupted[a]) arcs.push_back(a);
+        next->station_closed.assign(tot_station + 1, false);
+        next->edge_closed.assign(adj_station.size(), false);
+        next->edge_delay.assign(adj_station.size(), 0);
+        disrupt(next, arcs);
     }
 
-    vector<pair<int, string> > list_all_stations() {
+    vector<pair<int, string> > list_all_stations() const {
         /**
          * Return a vector contains all the stations supported with index and its name.
          * */
         vector<pair<int, string> > ret;
-        for(map<int, string>::iterator it = station_index_name.begin();
-                it != station_index_name.end();
-                ++it)
-            ret.push_back(make_pair(it->first, it->second));
+        for(int u = 1; u <= tot_station; ++u)
+            ret.push_back(make_pair(u, get_station_name(u)));
         return ret;
     }
 
-    vector<pair<string, vector<string> > > list_all_subway() {
+    vector<pair<string, vector<string> > > list_all_subway() const {
         /**
          * Return a vector contains all the subway with its stations.
          * */
         vector<pair<string, vector<string> > > ret;
-        for(map<string, set<string> >::iterator it = subway_stations.begin(); it != subway_stations.end(); ++it) {
-            string subway_name = it->first;
-            int num_stations = it->second.size();
-            vector<string> stations(num_stations);
-            copy(it->second.begin(), it->second.end(), stations.begin());
-            ret.push_back(make_pair(subway_name, stations));
+        for(int l = 0; l < tot_subway; ++l) {
+            vector<string> stations;
+            for(int i = subway_station_begin[l]; i < subway_station_begin[l + 1]; ++i)
+                stations.push_back(get_station_name(subway_station[i]));
+            ret.push_back(make_pair(get_subway_name(l), stations));
         }
         return ret;
     }
 
-    Response query(const int &start, const int &end, const string &dominate) {
+    Response query(const int &start, const int &end, const string &dominate) const {
         /**
          * Query start station to end station with "dominate" considering first.
          * Dominate: "Time", "Distance", "Interchange", "Money"
          * */
-        Comp comp(dominate.c_str());
-        string start_name = query_station_name(start),
-               end_name = query_station_name(end);
+        Route route;
+        query(start, end, dominate, route);
+        return to_response(route);
+    }
+
+    void query(
+            const int &start,
+            const int &end,
+            const string &dominate,
+            Route &ret
+            ) const {
+        /**
+         * Query as above into ret, naming no station, so that a caller
+         * reusing ret allocates nothing once it has grown.
+         * */
+        SearchWorkspace &workspace = thread_workspace();
+        answer(start, end, get_criterion(dominate), workspace, ret);
+    }
+
+    Response to_response(const Route &route) const {
+        /**
+         * The Response of a route, with the names copied.
+         * */
+        Response ret;
+        ret.money = route.money, ret.cost_time = route.cost_time;
+        ret.distance = route.distance;
+        ret.time_between_station = route.hop_time;
+        for(int s = 0; s < route.num_segment(); ++s) {
+            ret.path.push_back(make_pair(
+                        get_subway_name(route.segment_line[s]), vector<string>()
+                    ));
+            vector<string> &pass = ret.path.back().second;
+            for(int i = route.segment_begin[s]; i < route.segment_begin[s + 1]; ++i)
+                pass.push_back(get_station_name(route.station[i]));
+        }
+        return ret;
+    }
+
+    vector<Response> query_pareto(const int &start, const int &end) const {
+        /**
+         * Every trade-off between time, ticket fee and interchanges from
+         * start to end: each route returned is beaten by no other route
+         * on all three at once. Routes equal on all three are given once.
+         * Sorted by time, so the first is the fastest and the last is the
+         * cheapest. Empty if end is not reachable.
+         * */
+        vector<Response> ret;
+        if(start < 1 || start > tot_station || end < 1 || end > tot_station)
+            return ret;
+        if(start == end) {
+            ret.push_back(Response());
+            return ret;
+        }
+
+        SearchWorkspace &workspace = thread_workspace();
+        RcuPointer<const Disruption>::Guard disruption(disruptions);
+        workspace.disruption = disruption.get();
+        pareto_search(start, end, workspace);
+        vector<pair<long long, int> > order;
+        for(size_t i = 0; i < workspace.settled.size(); ++i) {
+            const ParetoLabel &label = workspace.labels[workspace.settled[i]];
+            if(label.dead) continue;
+            order.push_back(make_pair(
+                        ((long long) label.state.cost_time << 40) |
+                        ((long long) label.state.get_cost() << 20) |
+                        label.state.interchange, workspace.settled[i]
+                    ));
+        }
+        sort(order.begin(), order.end());
+        for(size_t i = 0; i < order.size(); ++i) {
+            vector<int> &arcs = workspace.arcs;
+            arcs.clear();
+            for(int l = order[i].second; workspace.labels[l].parent != -1;
+                    l = workspace.labels[l].parent)
+                arcs.push_back(workspace.labels[l].arc);
+            reverse(arcs.begin(), arcs.end());
+            ret.push_back(parse_response(
+                        workspace.labels[order[i].second].state, arcs, *disruption.get()
+                    ));
+        }
+        return ret;
+    }
+
+    vector<Response> query_alternatives(
+            const int &start,
+            const int &end,
+            const string &dominate,
+            const int &k
+            ) const {
+        /**
+         * Up to k routes from start to end, best first by "dominate" as in
+         * query, none passing a station twice. Routes that only differ from
+         * a better one in where they change lines are left out. The first
+         * is what query gives. Empty if end is not reachable.
+         * */
+        vector<Response> ret;
+        if(start < 1 || start > tot_station || end < 1 || end > tot_station || k <= 0)
+            return ret;
+        if(start == end) {
+            ret.push_back(Response());
+            return ret;
+        }
+
+        SearchWorkspace &workspace = thread_workspace();
+        RcuPointer<const Disruption>::Guard disruption(disruptions);
+        workspace.disruption = disruption.get();
+        vector<vector<int> > routes;
+        switch(get_criterion(dominate)) {
+            case CRITERION_DISTANCE:
+                alternatives<DistanceCriterion>(start, end, k, workspace, routes);
+                break;
+            case CRITERION_MONEY:
+                alternatives<MoneyCriterion>(start, end, k, workspace, routes);
+                break;
+            case CRITERION_INTERCHANGE:
+                alternatives<InterchangeCriterion>(start, end, k, workspace, routes);
+                break;
+            default:
+                alternatives<TimeCriterion>(start, end, k, workspace, routes);
+        }
+        for(size_t i = 0; i < routes.size(); ++i) {
+            vector<int> arcs(routes[i].begin() + 1, routes[i].end());
+            State label(0, 0, 0, 0);
+            for(size_t j = 0; j < arcs.size(); ++j)
+                label = relax(label, arcs[j], *disruption.get());
+            ret.push_back(parse_response(label, arcs, *disruption.get()));
+        }
+        return ret;
+    }
+
+    Response query_departure(const int &start, const int &end, const int &departure) const {
+        /**
+         * Query_departure below as a Response.
+         * */
+        Route route;
+        query_departure(start, end, departure, route);
+        return to_response(route);
+    }
+
+    void query_departure(
+            const int &start,
+            const int &end,
+            const int &departure,
+            Route &ret
+            ) const {
+        /**
+         * Earliest arrival from start to end leaving at departure, in minutes
+         * after midnight, waiting for trains as the timetables say.
+         * Cost_time is the whole journey from departure, waiting included,
+         * and each entry of time_between_station includes the wait before
+         * that hop. Among equally early arrivals, the one riding fewest
+         * trains is given. Cost_time is INF if end cannot be reached.
+         * */
+        ret.clear();
+        if(start < 1 || start > tot_station || end < 1 || end > tot_station) {
+            ret.money = ret.cost_time = INF, ret.distance = INF;
+            return;
+        }
+        if(start == end) return;
+
+        SearchWorkspace &workspace = thread_workspace();
+        RcuPointer<const Disruption>::Guard disruption(disruptions);
+        workspace.disruption = disruption.get();
+        int k = raptor(start, end, departure, workspace);
+        vector<int> &arcs = workspace.arcs;
+        arcs.clear();
+        if(k == -1) {
+            parse_route(State(), arcs, *disruption.get(), ret);
+            return;
+        }
+
+        /**
+         * Walk the rides back from end, then turn each into riding arcs of
+         * its line with an interchange arc between two rides.
+         * */
+        int width = tot_station + 1;
+        vector<pair<int, pair<int, int> > > rides;
+        for(int u = end; k > 0; --k) {
+            int r = workspace.ride_route[width * k + u];
+            int board = workspace.ride_board[width * k + u], alight = board;
+            while(timetable.route_stop[alight] != u) ++alight;
+            rides.push_back(make_pair(r, make_pair(board, alight)));
+            u = timetable.route_stop[board];
+        }
+        reverse(rides.begin(), rides.end());
+
+        vector<int> hop_arrival;
+        int trip = 0, last = -1;
+        for(size_t i = 0; i < rides.size(); ++i) {
+            int r = rides[i].first, subway = timetable.route_subway[r];
+            int board = rides[i].second.first, alight = rides[i].second.second;
+            int x = node_of(timetable.route_stop[board], subway);
+            if(last != -1) arcs.push_back(arc_to(last, x));
+            int ready = i == 0 ? departure :
+                hop_arrival.back() + INTERCHANGE_TIME;
+            timetable.next_trip(r, board, ready, disruption->route_delay, trip);
+            for(int j = board + 1; j <= alight; ++j) {
+                int y = node_of(timetable.route_stop[j], subway);
+                arcs.push_back(arc_to(x, y));
+                hop_arrival.push_back(timetable.arrival(j, trip, disruption->route_delay));
+                x = y;
+            }
+            last = x;
+        }
+
+        State label(0, 0, 0, 0);
+        for(size_t i = 0; i < arcs.size(); ++i)
+            label = relax(label, arcs[i], *disruption.get());
+        parse_route(label, arcs, *disruption.get(), ret);
+        ret.cost_time = hop_arrival.back() - departure;
+        for(size_t i = 0; i < hop_arrival.size(); ++i)
+            ret.hop_time[i] =
+                hop_arrival[i] - (i ? hop_arrival[i - 1] : departure);
+    }
+
+    ShortestPathTree query_all_from(const int &start, const string &dominate) const {
+        /**
+         * Query start station to every station at once, with "dominate"
+         * considering first. Cost of one query.
+         * */
+        return build_tree(start, get_criterion(dominate), INF);
+    }
+
+    ShortestPathTree query_reachable(
+            const int &start,
+            const double &budget,
+            const string &dominate
+            ) const {
+        /**
+         * Query every station reachable from start within budget, measured
+         * by "dominate": minutes for "Time", RMB for "Money", km for
+         * "Distance". The search stops at the budget, so small budgets
+         * are cheap. Stations out of reach are left as in query_all_from.
+         * */
+        return build_tree(start, get_criterion(dominate), budget);
+    }
+
+    Response query_tree_route(const ShortestPathTree &tree, const int &end) const {
+        /**
+         * The full route to end in a tree returned by query_all_from or
+         * query_reachable, the same as query would give.
+         * */
+        if(end < 1 || end >= (int) tree.target.size()) {
+            Response res;
+            res.money = res.cost_time = INF, res.distance = INF;
+            return res;
+        }
+        if(end == tree.start) {
+            Response res;
+            return res;
+        }
+
+        vector<int> arcs;
+        if(tree.target[end] != -1)
+            for(int e = tree.target[end]; tree.pre[e] != -1; e = tree.parent[e])
+                arcs.push_back(tree.pre[e]);
+        reverse(arcs.begin(), arcs.end());
+
+        RcuPointer<const Disruption>::Guard disruption(disruptions);
+        Response ret = parse_response(State(), arcs, *disruption.get());
+        if(!arcs.empty()) {
+            ret.money = tree.money[end];
+            ret.cost_time = tree.cost_time[end];
+            ret.distance = tree.distance[end];
+        }
+        return ret;
+    }
+
+    vector<Response> query_batch(
+            const vector<pair<int, int> > &pairs,
+            const string &dominate
+            ) const {
+        /**
+         * Query every (start, end) of pairs with "dominate" considering
+         * first, spread over the worker threads, each searching in its
+         * thread_workspace, so that repeated batches allocate nothing for
+         * the searches once the workers have grown them. Responses are
+         * returned in the order of pairs.
+         * Batches asked by different threads at once run one after another,
+         * since they share the workers of the Metro. A batch asked from a
+         * task already running on those workers, as a precompute or another
+         * batch would run it, is answered on that thread alone.
+         * */
+        vector<Route> routes;
+        query_batch(pairs, dominate, routes);
+        vector<Response> ret(routes.size());
+        for(size_t i = 0; i < routes.size(); ++i)
+            ret[i] = to_response(routes[i]);
+        return ret;
+    }
+
+    void query_batch(
+            const vector<pair<int, int> > &pairs,
+            const string &dominate,
+            vector<Route> &ret
+            ) const {
+        /**
+         * Query_batch into ret, one route per pair. Routes already in ret
+         * are reused, so a caller keeping ret across batches allocates
+         * little once it has grown.
+         * */
+        const int CHUNK = 64;
+        int criterion = get_criterion(dominate);
+        ret.resize(pairs.size());
+        int num_task = (pairs.size() + CHUNK - 1) / CHUNK;
+        get_pool().run(num_task,
+                [this, &pairs, &ret, criterion](int task, int) {
+                    SearchWorkspace &workspace = thread_workspace();
+                    int last = min((int) pairs.size(), (task + 1) * CHUNK);
+                    for(int i = task * CHUNK; i < last; ++i)
+                        answer(
+                                pairs[i].first, pairs[i].second,
+                                criterion, workspace, ret[i]
+                            );
+                });
+    }
+
+    void enable_cache(const size_t &capacity, const int &num_shard = 16) {
+        /**
+         * Keep the answers of up to capacity recent queries, split into
+         * num_shard independently locked shards.
+         * Replace the previous cache if there is one.
+         * */
+        route_cache.publish(new RouteCache<Route>(capacity, num_shard));
+    }
+
+    void disable_cache() {
+        route_cache.publish(NULL);
+    }
+
+    CacheStats cache_stats() const {
+        /**
+         * Counters of the query cache, all zero if it is not enabled.
+         * */
+        RcuPointer<const RouteCache<Route> >::Guard cache(route_cache);
+        if(cache.get() == NULL) return CacheStats();
+        return cache->stats();
+    }
+
+    void enable_stats() {
+        /**
+         * Start recording the queries answered by query and query_batch:
+         * their search work, wall time and route length per criterion.
+         * Restart from zero if they are already recorded. Without it a
+         * query only pays for a few counters kept in its workspace.
+         * */
+        query_recorder = make_shared<QueryRecorder>(NUM_CRITERION);
+    }
+
+    void share_stats(const Metro &other) {
+        /**
+         * Record queries into the counters of other, so that they carry
+         * on where other left off when this Metro replaces it, as a
+         * reloaded network does. Stats stay disabled if other has none.
+         * */
+        query_recorder = other.query_recorder;
+    }
+
+    void disable_stats() {
+        query_recorder.reset();
+    }
+
+    MetroStats stats() const {
+        /**
+         * The query counters, if enable_stats was called, and the memory
+         * held by the network, its indexes and the cache. Format_prometheus
+         * writes them as text. Sizing the cache takes a pass over it.
+         * */
+        MetroStats ret;
+        ret.enabled = query_recorder != NULL;
+        for(int c = 0; ret.enabled && c < NUM_CRITERION; ++c) {
+            ret.criterion.push_back(query_recorder->read(c));
+            ret.criterion.back().name = CRITERION_NAME[c];
+        }
 
-        Response ret = spfa(start_name, end_name, comp);
+        MemoryStats &memory = ret.memory;
+#define ARRAY_BYTES(type, name) + (long long) name.size() * sizeof(type)
+        memory.graph = 0 NETWORK_ARRAYS(ARRAY_BYTES);
+        memory.names = 0 ARRAY_BYTES(char, name_pool) ARRAY_BYTES(int, station_name_begin)
+            ARRAY_BYTES(int, station_by_name) ARRAY_BYTES(int, subway_name_begin);
+#undef ARRAY_BYTES
+        memory.graph -= memory.names;
+        memory.names += station_index.memory();
+        RcuPointer<const Disruption>::Guard disruption(disruptions);
+        memory.graph += loaded.memory() + disruption->memory();
+        memory.timetable = timetable.memory();
+        for(size_t c = 0; c < route_tables.size(); ++c) {
+            const RouteTable &table = route_tables[c];
+            memory.tables += (table.target.capacity() + table.money.capacity() +
+                    table.cost_time.capacity() + table.pre.capacity()) *
+                sizeof(unsigned short) + table.distance.capacity() * sizeof(int);
+        }
+        memory.landmarks = (landmarks.landmark.capacity() + landmarks.rev_begin.capacity() +
+                landmarks.rev_arc.capacity()) * sizeof(int);
+        for(int m = 0; m < 2; ++m) {
+            memory.landmarks += (landmarks.to[m].capacity() +
+                    landmarks.from[m].capacity()) * sizeof(int);
+            memory.hierarchy += hierarchy[m].memory();
+        }
+        RcuPointer<const RouteCache<Route> >::Guard cache(route_cache);
+        if(cache.get() != NULL) ret.cache = cache->stats(route_bytes);
+        memory.cache = ret.cache.bytes;
         return ret;
     }
 
-    Response query_money(const int &start, const int &end) {
+    Response query_money(const int &start, const int &end) const {
         /**
          * A old interface, not suggested.
          * Please use query instead.
@@ -498,7 +3358,7 @@ public :
         return query(start, end, "Money");
     }
 
-    Response query_distance(const int &start, const int &end) {
+    Response query_distance(const int &start, const int &end) const {
         /**
          * A old interface, not suggested.
          * Please use query instead.
@@ -506,7 +3366,7 @@ public :
         return query(start, end, "Distance");
     }
 
-    Response query_time(const int &start, const int &end) {
+    Response query_time(const int &start, const int &end) const {
         /**
          * A old interface, not suggested.
          * Please use query instead.
@@ -514,23 +3374,64 @@ public :
         return query(start, end, "Time");
     }
 
-    int query_station_index(const string &name) {
+    int query_station_index(const string &name) const {
         /**
          * Query the corresponding index of the name.
          * If the name is not considered as a station's name, it return -1.
          * */
-        if(station_name_index.find(name) != station_name_index.end())
-            return station_name_index[name];
+        int low = 0, high = station_by_name.size();
+        while(low < high) {
+            int mid = (low + high) / 2;
+            const char *now = &name_pool[station_name_begin[station_by_name[mid]]];
+            if(name.compare(now) > 0) low = mid + 1;
+            else high = mid;
+        }
+        if(low < station_by_name.size() &&
+                name.compare(&name_pool[station_name_begin[station_by_name[low]]]) == 0)
+            return station_by_name[low];
         return -1;
     }
 
-    string query_station_name(const int &index) {
+    int match_station(string_view text, const int &limit, vector<StationMatch> &ret) const {
+        /**
+         * Up to limit stations for a name being typed, best first, see
+         * StationIndex::match. Letter case is ignored, and a few typos are
+         * allowed once text is three characters long.
+         * */
+        return station_index.match(text, limit, ret);
+    }
+
+    string_view station_name(const int &index) const {
+        /**
+         * Name of a valid station index as a view into the loaded network,
+         * valid until the network is loaded again.
+         * */
+        return string_view(&name_pool[station_name_begin[index]],
+                station_name_begin[index + 1] - station_name_begin[index] - 1);
+    }
+
+    string_view line_name(const int &subway) const {
+        /**
+         * Name of a valid line index, as station_name.
+         * */
+        return string_view(&name_pool[subway_name_begin[subway]],
+                subway_name_begin[subway + 1] - subway_name_begin[subway] - 1);
+    }
+
+    int num_station() const {
+        /**
+         * Number of stations, indexed from 1.
+         * */
+        return tot_station;
+    }
+
+    string query_station_name(const int &index) const {
         /**
          * Query the corresponding name of the index.
          * If the index is not a station index, it return empty string "".
          * */
-        if(station_index_name.find(index) != station_index_name.end())
-            return station_index_name[index];
+        if(index >= 1 && index <= tot_station)
+            return get_station_name(index);
         return "";
     }
 
@@ -0,0 +1,294 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+template <class T>
+struct ArrayRef {
+    /**
+     * A read-only view of a contiguous array, which lives either in a vector
+     * or inside a mapped snapshot file.
+     * */
+    const T *data;
+    int length;
+
+    ArrayRef() : data(NULL), length(0) {}
+
+    ArrayRef(const std::vector<T> &v) :
+        data(v.empty() ? NULL : &v[0]), length(v.size()) {}
+
+    ArrayRef(const T *data, const int &length) : data(data), length(length) {}
+
+    const T &operator [](const int &i) const {
+        return data[i];
+    }
+
+    int size() const {
+        return length;
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+};
+
+/**
+ * Every flat array describing a loaded network, as (element type, name).
+ * Strings:
+ *   Name_pool: All station and line names, each followed by a '\0'.
+ *   Station_name_begin: Offset in name_pool of the name of each station
+ *                       index, 0 is unused.
+ *   Station_by_name: Station indices sorted by name.
+ *   Subway_name_begin: Offset in name_pool of the name of each line, lines
+ *                      are indexed in name order.
+ *   Subway_fare_free: 1 for lines not charged by distance (APM).
+ *   Subway_station: Stations of line l sorted by name, stored in
+ *                   [subway_station_begin[l], subway_station_begin[l + 1]).
+ * The station graph and the line-expanded graph are described in Metro.
+ * The order is the order of the sections of a snapshot file.
+ * */
+#define NETWORK_ARRAYS(X) \
+    X(char, name_pool) \
+    X(int, station_name_begin) \
+    X(int, station_by_name) \
+    X(int, subway_name_begin) \
+    X(unsigned char, subway_fare_free) \
+    X(int, subway_station_begin) \
+    X(int, subway_station) \
+    X(int, adj_begin) \
+    X(int, adj_station) \
+    X(int, adj_time) \
+    X(int, adj_distance) \
+    X(int, adj_subway) \
+    X(int, station_node_begin) \
+    X(int, node_station) \
+    X(int, node_subway) \
+    X(int, arc_begin) \
+    X(int, arc_from) \
+    X(int, arc_node) \
+    X(int, arc_edge)
+
+#define COUNT_ARRAY(type, name) + 1
+#define NUM_NETWORK_ARRAY (0 NETWORK_ARRAYS(COUNT_ARRAY))
+
+struct NetworkArrays {
+    /**
+     * Owned storage of the arrays of NETWORK_ARRAYS, filled when a network
+     * is loaded from the text data.
+     * */
+#define DECLARE_VECTOR(type, name) std::vector<type> name;
+    NETWORK_ARRAYS(DECLARE_VECTOR)
+#undef DECLARE_VECTOR
+};
+
+#define SNAPSHOT_MAGIC "METROSNP"
+#define SNAPSHOT_VERSION (2)
+/**
+ * Raised whenever the arrays of a snapshot change meaning. Version 2: every
+ * line whose name starts with APM is fare-free in subway_fare_free.
+ * */
+#define SNAPSHOT_BYTE_ORDER (0x01020304)
+
+struct SnapshotHeader {
+    /**
+     * Start of a snapshot file, followed by one SnapshotSection per array
+     * of NETWORK_ARRAYS and then the array data, each 8-byte aligned.
+     * Magic, Version, Byte_order: Identify the format, a snapshot is only
+     *                             read on a machine of the same byte order.
+     * Checksum: 64-bit FNV-1a of everything after the header.
+     * Size: Size of the whole file.
+     * */
+    char magic[8];
+    unsigned int version, byte_order, num_array, reserved;
+    unsigned long long checksum, size;
+};
+
+struct SnapshotSection {
+    unsigned long long offset, count, element_size;
+};
+
+unsigned long long snapshot_checksum(const char *data, const size_t &size) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool write_snapshot(const std::string &filename, const NetworkArrays &arrays) {
+    /**
+     * Write arrays to filename in the snapshot format.
+     * Return false if the file cannot be written.
+     * */
+    std::vector<SnapshotSection> sections;
+    unsigned long long offset = sizeof(SnapshotHeader)
+        + sizeof(SnapshotSection) * NUM_NETWORK_ARRAY;
+#define ADD_SECTION(type, name) { \
+        SnapshotSection section; \
+        offset = (offset + 7) / 8 * 8; \
+        section.offset = offset; \
+        section.count = arrays.name.size(); \
+        section.element_size = sizeof(type); \
+        offset += section.count * sizeof(type); \
+        sections.push_back(section); \
+    }
+    NETWORK_ARRAYS(ADD_SECTION)
+#undef ADD_SECTION
+
+    std::vector<char> file(offset, 0);
+    memcpy(&file[sizeof(SnapshotHeader)], &sections[0],
+            sizeof(SnapshotSection) * NUM_NETWORK_ARRAY);
+    int k = 0;
+#define COPY_SECTION(type, name) { \
+        if(!arrays.name.empty()) \
+            memcpy(&file[sections[k].offset], &arrays.name[0], \
+                    sections[k].count * sizeof(type)); \
+        ++k; \
+    }
+    NETWORK_ARRAYS(COPY_SECTION)
+#undef COPY_SECTION
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.num_array = NUM_NETWORK_ARRAY;
+    header.size = offset;
+    header.checksum = snapshot_checksum(
+            &file[sizeof(SnapshotHeader)], offset - sizeof(SnapshotHeader)
+        );
+    memcpy(&file[0], &header, sizeof(header));
+
+    /**
+     * Write a new file and rename it over filename, so that a process
+     * with the old snapshot mapped keeps reading the old file.
+     * */
+    std::string temp = filename + ".tmp";
+    FILE *out = fopen(temp.c_str(), "wb");
+    if(out == NULL) return false;
+    bool ok = fwrite(&file[0], 1, file.size(), out) == file.size();
+    ok = fclose(out) == 0 && ok;
+    #ifdef WIN32
+    if(ok) remove(filename.c_str());
+    #endif
+    ok = ok && rename(temp.c_str(), filename.c_str()) == 0;
+    if(!ok) remove(temp.c_str());
+    return ok;
+}
+
+class SnapshotFile {
+    /**
+     * A snapshot file opened for reading. The file is mapped into memory
+     * (read into a buffer on Windows) and stays there until the object is
+     * destroyed, so views into it remain valid as long as the object lives.
+     * */
+private :
+    const char *data;
+    size_t size;
+    std::vector<char> buffer;
+
+    SnapshotFile(const SnapshotFile &);
+    SnapshotFile &operator =(const SnapshotFile &);
+
+public :
+    SnapshotFile() : data(NULL), size(0) {}
+
+    ~SnapshotFile() {
+        close();
+    }
+
+    bool empty() const {
+        return data == NULL;
+    }
+
+    void swap(SnapshotFile &t) {
+        std::swap(data, t.data);
+        std::swap(size, t.size);
+        buffer.swap(t.buffer);
+    }
+
+    void close() {
+        #ifndef WIN32
+        if(data != NULL && buffer.empty())
+            munmap((void *) data, size);
+        #endif
+        data = NULL, size = 0;
+        buffer.clear();
+    }
+
+    bool open(const std::string &filename) {
+        /**
+         * Map filename and check its header and checksum.
+         * Return false if it is missing or not a valid snapshot.
+         * */
+        close();
+        #ifdef WIN32
+        std::ifstream in(filename.c_str(), std::ios::binary);
+        if(!in) return false;
+        buffer.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+        if(buffer.empty()) return false;
+        data = &buffer[0], size = buffer.size();
+        #else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat info;
+        if(fstat(fd, &info) != 0 || info.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mapped == MAP_FAILED) return false;
+        data = (const char *) mapped, size = info.st_size;
+        #endif
+
+        const SnapshotHeader *header = (const SnapshotHeader *) data;
+        size_t table_end = sizeof(SnapshotHeader)
+            + sizeof(SnapshotSection) * NUM_NETWORK_ARRAY;
+        if(size < table_end
+                || memcmp(header->magic, SNAPSHOT_MAGIC, 8) != 0
+                || header->version != SNAPSHOT_VERSION
+                || header->byte_order != SNAPSHOT_BYTE_ORDER
+                || header->num_array != NUM_NETWORK_ARRAY
+                || header->size != size
+                || header->checksum != snapshot_checksum(
+                    data + sizeof(SnapshotHeader), size - sizeof(SnapshotHeader)
+                    )) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    template <class T>
+    bool get_array(const int &k, ArrayRef<T> &array) const {
+        /**
+         * View the k-th array of the snapshot in place.
+         * Return false if the section does not fit the file or T.
+         * */
+        const SnapshotSection *section = (const SnapshotSection *)
+            (data + sizeof(SnapshotHeader)) + k;
+        if(section->element_size != sizeof(T)
+                || section->offset % 8 != 0
+                || section->offset > size
+                || section->count > (size - section->offset) / sizeof(T)
+                || section->count > 0x7fffffffULL)
+            return false;
+        array = ArrayRef<T>((const T *) (data + section->offset), section->count);
+        return true;
+    }
+};
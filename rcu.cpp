@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#define RCU_MAX_READER (1024)
+/**
+ * Threads that can read RcuPointers at the same time. Each takes a slot on
+ * its first read and gives it back when it exits; a thread reading once
+ * every slot is taken aborts the process rather than wait, since a slot
+ * may never be given back.
+ * */
+
+#define RCU_MAX_HOLD (4)
+/**
+ * Different RcuPointers a thread can hold guards of at the same time, such
+ * as a served network and its disruptions. Holding more aborts too.
+ * */
+
+struct alignas(64) RcuHazard {
+    /**
+     * The versions a reader thread holds (hazard pointers), one per
+     * pointer it is reading, in a cache line of its own.
+     * Owner: The RcuPointer each version is of, only used by the thread.
+     * Release: Whether the thread deletes the version when its guard
+     *          ends, as the thread itself published a newer one meanwhile.
+     * */
+    std::atomic<const void *> version[RCU_MAX_HOLD];
+    const void *owner[RCU_MAX_HOLD];
+    bool release[RCU_MAX_HOLD];
+};
+
+/**
+ * Hazards of every reader thread, shared by all RcuPointers, with the
+ * slots in use and one past the highest slot ever taken, so that
+ * publishers only scan those.
+ * */
+RcuHazard rcu_hazard[RCU_MAX_READER];
+std::atomic<bool> rcu_slot_used[RCU_MAX_READER];
+std::atomic<int> rcu_slot_limit(0);
+
+struct RcuSlot {
+    /**
+     * The reader slot of a thread, taken on its first read and given back
+     * when the thread exits.
+     * */
+    int index;
+
+    RcuSlot() {
+        for(index = 0; index < RCU_MAX_READER; ++index) {
+            bool expected = false;
+            if(rcu_slot_used[index].compare_exchange_strong(expected, true)) break;
+        }
+        if(index == RCU_MAX_READER) {
+            fprintf(stderr, "More than %d threads read RcuPointers at once\n", RCU_MAX_READER);
+            abort();
+        }
+        int limit = rcu_slot_limit.load();
+        while(limit <= index && !rcu_slot_limit.compare_exchange_weak(limit, index + 1));
+        for(int i = 0; i < RCU_MAX_HOLD; ++i) {
+            rcu_hazard[index].version[i].store(NULL);
+            rcu_hazard[index].owner[i] = NULL;
+            rcu_hazard[index].release[i] = false;
+        }
+    }
+
+    ~RcuSlot() {
+        rcu_slot_used[index].store(false);
+    }
+};
+
+int rcu_slot() {
+    static thread_local RcuSlot slot;
+    return slot.index;
+}
+
+template <class T>
+class RcuPointer {
+    /**
+     * The current version of a T, or NULL, that is not changed once
+     * published. Readers take it through a Guard without any lock: the guard
+     * announces the version in the hazards of its thread and checks it is
+     * still current. Publish swaps in a new version, waits until no other
+     * thread announces the old one, and deletes it, so a reader keeps its
+     * version to the end of its guard however many are published
+     * meanwhile. Reading only writes the hazards of the reader, so a const
+     * RcuPointer can be read too. See RCU_MAX_READER and RCU_MAX_HOLD for
+     * the limits on readers.
+     * */
+private :
+    std::atomic<T *> current;
+    std::mutex writer;
+
+    RcuPointer(const RcuPointer &);
+    RcuPointer &operator =(const RcuPointer &);
+
+public :
+    class Guard {
+        /**
+         * The version current when the guard was made, kept until it is
+         * destroyed. A guard made while the thread already holds one of
+         * the same pointer shares that version.
+         * */
+    private :
+        T *version;
+        int slot, hold;
+        bool nested;
+
+        Guard(const Guard &);
+        Guard &operator =(const Guard &);
+
+    public :
+        Guard(const RcuPointer &pointer) {
+            slot = rcu_slot();
+            RcuHazard &hazard = rcu_hazard[slot];
+            int free_hold = -1;
+            for(hold = 0; hold < RCU_MAX_HOLD; ++hold) {
+                if(hazard.owner[hold] == &pointer) break;
+                if(hazard.owner[hold] == NULL && free_hold == -1) free_hold = hold;
+            }
+            nested = hold < RCU_MAX_HOLD;
+            if(nested) {
+                version = (T *) hazard.version[hold].load();
+                return;
+            }
+            if(free_hold == -1) {
+                fprintf(stderr, "A thread holds more than %d RcuPointers at once\n",
+                        RCU_MAX_HOLD);
+                abort();
+            }
+            hold = free_hold;
+            hazard.owner[hold] = &pointer;
+            do {
+                version = pointer.current.load();
+                hazard.version[hold].store(version);
+            } while(version != pointer.current.load());
+        }
+
+        ~Guard() {
+            if(nested) return;
+            RcuHazard &hazard = rcu_hazard[slot];
+            hazard.version[hold].store(NULL);
+            hazard.owner[hold] = NULL;
+            if(hazard.release[hold]) {
+                hazard.release[hold] = false;
+                delete version;
+            }
+        }
+
+        const T *get() const {
+            return version;
+        }
+
+        const T *operator ->() const {
+            return version;
+        }
+    };
+
+    RcuPointer(T *first) {
+        current.store(first);
+    }
+
+    ~RcuPointer() {
+        delete current.load();
+    }
+
+    void publish(T *next) {
+        /**
+         * Make next the current version and delete the previous one once
+         * no reader holds it. Publishers wait for each other. A thread
+         * publishing while it holds a guard of this pointer does not wait
+         * for itself: the previous version is deleted when that guard ends.
+         * */
+        std::lock_guard<std::mutex> guard(writer);
+        T *old = current.exchange(next);
+        if(old == NULL) return;
+        int self = rcu_slot(), limit = rcu_slot_limit.load();
+        for(int i = 0; i < limit; ++i)
+            for(int k = 0; k < RCU_MAX_HOLD; ++k)
+                while(i != self && rcu_hazard[i].version[k].load() == old)
+                    std::this_thread::yield();
+        RcuHazard &hazard = rcu_hazard[self];
+        for(int k = 0; k < RCU_MAX_HOLD; ++k)
+            if(hazard.owner[k] == this && hazard.version[k].load() == old) {
+                hazard.release[k] = true;
+                return;
+            }
+        delete old;
+    }
+};
@@ -0,0 +1,106 @@
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define RELOAD_QUIET_MS (500)
+/**
+ * A change to the watched directory is only loaded once the directory
+ * has been quiet this long, so that files still being written are not
+ * read half way.
+ * */
+
+template <class T>
+class Reloader {
+    /**
+     * Watch a directory with inotify and, after it changes, build a new
+     * version of T on a background thread and publish it. A build that
+     * returns NULL keeps the current version.
+     * */
+public :
+    typedef std::function<T *()> Builder;
+
+private :
+    RcuPointer<T> &target;
+    Builder build;
+    int notify_fd, event_fd;
+    std::thread worker;
+
+    Reloader(const Reloader &);
+    Reloader &operator =(const Reloader &);
+
+    void run() {
+        pollfd fds[2];
+        fds[0].fd = notify_fd, fds[0].events = POLLIN;
+        fds[1].fd = event_fd, fds[1].events = POLLIN;
+        char buffer[4096];
+        bool changed = false;
+        while(true) {
+            fds[0].revents = fds[1].revents = 0;
+            int n = poll(fds, 2, changed ? RELOAD_QUIET_MS : -1);
+            if(n == -1 && errno != EINTR) return;
+            if(fds[1].revents & POLLIN) return;
+            if(fds[0].revents & POLLIN) {
+                while(read(notify_fd, buffer, sizeof(buffer)) > 0)
+                    ;
+                changed = true;
+                continue;
+            }
+            if(n != 0 || !changed) continue;
+            changed = false;
+            T *next = build();
+            if(next == NULL) {
+                fprintf(stderr, "Reload failed, keeping the current network\n");
+                continue;
+            }
+            target.publish(next);
+            fprintf(stderr, "Reloaded the network\n");
+        }
+    }
+
+public :
+    Reloader(RcuPointer<T> &pointer, const Builder &builder) :
+        target(pointer), build(builder) {
+        notify_fd = inotify_init1(IN_NONBLOCK);
+        event_fd = eventfd(0, EFD_NONBLOCK);
+    }
+
+    ~Reloader() {
+        stop();
+        close(notify_fd);
+        close(event_fd);
+    }
+
+    bool watch(const std::string &directory) {
+        /**
+         * Start watching directory for files written, moved in or removed.
+         * Return false with errno set if it cannot be watched.
+         * */
+        if(notify_fd == -1 || event_fd == -1) return false;
+        if(inotify_add_watch(notify_fd, directory.c_str(),
+                    IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                    IN_CREATE | IN_DELETE) == -1)
+            return false;
+        if(!worker.joinable())
+            worker = std::thread(&Reloader::run, this);
+        return true;
+    }
+
+    void stop() {
+        /**
+         * Stop watching, waiting for a build in progress.
+         * */
+        if(!worker.joinable()) return;
+        uint64_t one = 1;
+        ssize_t ret = write(event_fd, &one, sizeof(one));
+        (void) ret;
+        worker.join();
+    }
+};
@@ -0,0 +1,162 @@
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct CacheStats {
+    /**
+     * Counters of a RouteCache since it was created.
+     * Hit, Miss: Lookups answered and not answered by the cache.
+     * Eviction: Entries dropped to stay within the capacity.
+     * Size: Entries currently held.
+     * Bytes: Memory the entries take, estimated.
+     * */
+    long long hit, miss, eviction, size, bytes;
+
+    CacheStats() {
+        hit = miss = eviction = size = bytes = 0;
+    }
+};
+
+template <class Value>
+class RouteCache {
+    /**
+     * A bounded least-recently-used cache from integer keys to Value.
+     * Keys are spread over independent shards, each with its own lock and
+     * its own share of the capacity, so concurrent readers of different
+     * keys rarely wait for each other. Every operation locks what it
+     * touches, so all of them are const and a const RouteCache can be
+     * shared between threads.
+     * */
+private :
+    struct Shard {
+        std::mutex lock;
+        std::list<std::pair<long long, Value> > entries;
+        std::unordered_map<long long,
+            typename std::list<std::pair<long long, Value> >::iterator> index;
+        size_t capacity;
+        long long hit, miss, eviction;
+    };
+
+    mutable std::vector<Shard> shards;
+
+    Shard &get_shard(const long long &key) const {
+        unsigned long long hash = (unsigned long long) key * 0x9E3779B97F4A7C15ULL;
+        return shards[(hash >> 32) % shards.size()];
+    }
+
+public :
+    RouteCache(const size_t &capacity, const int &num_shard) :
+        shards(num_shard < 1 ? 1 : num_shard) {
+        /**
+         * Capacity is the total number of entries kept by all shards.
+         * */
+        for(size_t i = 0; i < shards.size(); ++i) {
+            shards[i].capacity = capacity / shards.size();
+            if(i < capacity % shards.size()) ++shards[i].capacity;
+            shards[i].hit = shards[i].miss = shards[i].eviction = 0;
+        }
+    }
+
+    bool get(const long long &key, Value &value) const {
+        /**
+         * Copy the value of key into value and mark it as recently used.
+         * Return false if key is not cached.
+         * */
+        Shard &shard = get_shard(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        typename std::unordered_map<long long,
+            typename std::list<std::pair<long long, Value> >::iterator>::iterator
+            it = shard.index.find(key);
+        if(it == shard.index.end()) {
+            ++shard.miss;
+            return false;
+        }
+        ++shard.hit;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        value = it->second->second;
+        return true;
+    }
+
+    void put(const long long &key, const Value &value) const {
+        /**
+         * Cache value for key, dropping the least recently used entry of the
+         * shard if it is full.
+         * */
+        Shard &shard = get_shard(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        if(shard.capacity == 0) return;
+        typename std::unordered_map<long long,
+            typename std::list<std::pair<long long, Value> >::iterator>::iterator
+            it = shard.index.find(key);
+        if(it != shard.index.end()) {
+            it->second->second = value;
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return;
+        }
+        if(shard.entries.size() >= shard.capacity) {
+            shard.index.erase(shard.entries.back().first);
+            shard.entries.pop_back();
+            ++shard.eviction;
+        }
+        shard.entries.push_front(std::make_pair(key, value));
+        shard.index[key] = shard.entries.begin();
+    }
+
+    void clear() const {
+        /**
+         * Drop every entry. The counters are kept.
+         * */
+        for(size_t i = 0; i < shards.size(); ++i) {
+            std::lock_guard<std::mutex> guard(shards[i].lock);
+            shards[i].entries.clear();
+            shards[i].index.clear();
+        }
+    }
+
+    template <class Predicate>
+    void erase_if(Predicate pred) const {
+        /**
+         * Drop every entry whose value pred returns true for. The
+         * counters are kept.
+         * */
+        for(size_t i = 0; i < shards.size(); ++i) {
+            std::lock_guard<std::mutex> guard(shards[i].lock);
+            Shard &shard = shards[i];
+            for(typename std::list<std::pair<long long, Value> >::iterator
+                    it = shard.entries.begin(); it != shard.entries.end(); )
+                if(pred(it->second)) {
+                    shard.index.erase(it->first);
+                    it = shard.entries.erase(it);
+                } else ++it;
+        }
+    }
+
+    CacheStats stats(size_t (*value_bytes)(const Value &) = NULL) const {
+        /**
+         * Sum up the counters of all shards. Bytes counts the list and
+         * index nodes of each entry, plus what value_bytes gives for its
+         * value unless it is NULL, which takes a pass over every entry.
+         * */
+        typedef typename std::unordered_map<long long,
+            typename std::list<std::pair<long long, Value> >::iterator>::value_type
+            IndexEntry;
+        CacheStats ret;
+        for(size_t i = 0; i < shards.size(); ++i) {
+            std::lock_guard<std::mutex> guard(shards[i].lock);
+            const Shard &shard = shards[i];
+            ret.hit += shard.hit;
+            ret.miss += shard.miss;
+            ret.eviction += shard.eviction;
+            ret.size += shard.entries.size();
+            ret.bytes += shard.entries.size() * (sizeof(std::pair<long long, Value>) +
+                    sizeof(IndexEntry) + 4 * sizeof(void *)) +
+                shard.index.bucket_count() * sizeof(void *);
+            if(value_bytes != NULL)
+                for(typename std::list<std::pair<long long, Value> >::const_iterator
+                        it = shard.entries.begin(); it != shard.entries.end(); ++it)
+                    ret.bytes += value_bytes(it->second);
+        }
+        return ret;
+    }
+};
@@ -0,0 +1,434 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_MAX_PENDING (4096)
+/**
+ * A connection stops reading while this many of its requests are
+ * unanswered, and resumes once half of them are.
+ * */
+
+#define SERVER_MAX_LINE (4096)
+/**
+ * Longest request in bytes. A longer one is answered with an error and
+ * the connection is closed after it.
+ * */
+
+#define SERVER_MAX_TAKE (64)
+/**
+ * Most jobs a worker takes from the queue at a time.
+ * */
+
+class QueryServer {
+    /**
+     * A line based query server on a Unix or TCP socket.
+     * Every line a client sends is one request and gets exactly one line
+     * back. Clients may send many requests without waiting (pipelining);
+     * answers on a connection always come back in request order.
+     * One thread runs the epoll loop and owns every connection. Requests
+     * are answered by a fixed set of worker threads, which hand the answers
+     * back to the loop through an eventfd.
+     * A request still waiting for a worker when its deadline passes is
+     * answered with timeout_reply instead.
+     * */
+public :
+    typedef std::function<void(const std::string &request, std::string &reply)> Handler;
+    typedef std::chrono::steady_clock Clock;
+
+private :
+    struct Job {
+        long long connection, seq;
+        std::string text;
+        Clock::time_point deadline;
+    };
+
+    struct Connection {
+        int fd;
+        std::string input, output;
+        long long next_seq, next_reply;
+        std::map<long long, std::string> ready;
+        bool reading, closing;
+    };
+
+    Handler handler;
+    std::string timeout_reply, long_line_reply;
+    std::chrono::milliseconds deadline;
+    int listen_fd, epoll_fd, event_fd;
+    std::string unix_path;
+
+    std::map<long long, Connection> connections;
+    long long next_connection;
+
+    std::vector<std::thread> workers;
+    size_t num_worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    std::vector<Job> done;
+    bool stopping;
+
+    /**
+     * Set by stop, which may run in a signal handler on any thread, so it
+     * is a lock-free atomic rather than volatile.
+     * */
+    std::atomic<bool> quit;
+
+    QueryServer(const QueryServer &);
+    QueryServer &operator=(const QueryServer &);
+
+    static bool set_nonblocking(const int &fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+    }
+
+    void watch(const long long &id, const int &op, const unsigned &events) {
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.u64 = id;
+        epoll_ctl(epoll_fd, op, connections[id].fd, &ev);
+    }
+
+    void update_events(const long long &id) {
+        Connection &conn = connections[id];
+        unsigned events = 0;
+        if(conn.reading) events |= EPOLLIN;
+        if(!conn.output.empty()) events |= EPOLLOUT;
+        watch(id, EPOLL_CTL_MOD, events);
+    }
+
+    void work() {
+        /**
+         * Jobs are taken and handed back in groups of up to SERVER_MAX_TAKE, a
+         * fair share of the queue, so that a busy server wakes the loop
+         * once per group rather than once per request.
+         * */
+        std::vector<Job> taken;
+        while(true) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                while(!stopping && jobs.empty())
+                    wake.wait(guard);
+                if(stopping) return;
+                size_t count = std::min((size_t) SERVER_MAX_TAKE,
+                        (jobs.size() + num_worker - 1) / num_worker);
+                taken.assign(jobs.begin(), jobs.begin() + count);
+                jobs.erase(jobs.begin(), jobs.begin() + count);
+            }
+            for(size_t i = 0; i < taken.size(); ++i) {
+                std::string reply;
+                if(Clock::now() > taken[i].deadline) reply = timeout_reply;
+                else handler(taken[i].text, reply);
+                taken[i].text.swap(reply);
+            }
+            bool first;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                first = done.empty();
+                done.insert(done.end(), taken.begin(), taken.end());
+            }
+            if(first) {
+                uint64_t one = 1;
+                ssize_t ret = write(event_fd, &one, sizeof(one));
+                (void) ret;
+            }
+        }
+    }
+
+    void accept_all() {
+        while(true) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if(fd == -1) return;
+            if(!set_nonblocking(fd)) {
+                close(fd);
+                continue;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            long long id = next_connection++;
+            Connection &conn = connections[id];
+            conn.fd = fd;
+            conn.next_seq = conn.next_reply = 0;
+            conn.reading = true, conn.closing = false;
+            watch(id, EPOLL_CTL_ADD, EPOLLIN);
+        }
+    }
+
+    void close_connection(const long long &id) {
+        /**
+         * Answers still being worked on for this connection are dropped
+         * when they come back.
+         * */
+        close(connections[id].fd);
+        connections.erase(id);
+    }
+
+    bool finished(const Connection &conn) const {
+        return conn.closing && conn.next_reply == conn.next_seq && conn.output.empty();
+    }
+
+    void read_requests(const long long &id) {
+        Connection &conn = connections[id];
+        char buffer[1 << 16];
+        std::vector<Job> incoming;
+        while(conn.reading) {
+            ssize_t n = read(conn.fd, buffer, sizeof(buffer));
+            if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if(n == -1 && errno == EINTR) continue;
+            if(n <= 0) {
+                conn.reading = false, conn.closing = true;
+                break;
+            }
+            conn.input.append(buffer, n);
+            size_t begin = 0, end;
+            while((end = conn.input.find('\n', begin)) != std::string::npos) {
+                if(end - begin > SERVER_MAX_LINE) break;
+                Job job;
+                job.connection = id, job.seq = conn.next_seq++;
+                job.text.assign(conn.input, begin, end - begin);
+                job.deadline = Clock::now() + deadline;
+                incoming.push_back(job);
+                begin = end + 1;
+            }
+            conn.input.erase(0, begin);
+            /**
+             * Either a whole line or the unfinished one is too long. The
+             * lines before it are still answered.
+             * */
+            end = conn.input.find('\n');
+            if((end == std::string::npos ? conn.input.size() : end) > SERVER_MAX_LINE) {
+                conn.ready[conn.next_seq++] = long_line_reply;
+                conn.reading = false, conn.closing = true;
+                conn.input.clear();
+            }
+            if(conn.next_seq - conn.next_reply >= SERVER_MAX_PENDING) conn.reading = false;
+        }
+        if(!incoming.empty()) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                jobs.insert(jobs.end(), incoming.begin(), incoming.end());
+            }
+            if(incoming.size() == 1) wake.notify_one();
+            else wake.notify_all();
+        }
+        flush_ready(id);
+    }
+
+    void flush_ready(const long long &id) {
+        /**
+         * Move answers that are next in order to the output and write as
+         * much of it as the socket takes.
+         * */
+        Connection &conn = connections[id];
+        std::map<long long, std::string>::iterator it;
+        while((it = conn.ready.find(conn.next_reply)) != conn.ready.end()) {
+            conn.output += it->second;
+            conn.output += '\n';
+            conn.ready.erase(it);
+            ++conn.next_reply;
+        }
+        size_t written = 0;
+        while(written < conn.output.size()) {
+            ssize_t n = send(conn.fd, conn.output.data() + written,
+                    conn.output.size() - written, MSG_NOSIGNAL);
+            if(n == -1 && errno == EINTR) continue;
+            if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if(n <= 0) {
+                close_connection(id);
+                return;
+            }
+            written += n;
+        }
+        conn.output.erase(0, written);
+        if(!conn.closing && !conn.reading &&
+                conn.next_seq - conn.next_reply < SERVER_MAX_PENDING / 2)
+            conn.reading = true;
+        if(finished(conn)) {
+            close_connection(id);
+            return;
+        }
+        update_events(id);
+    }
+
+    void collect_replies() {
+        uint64_t count;
+        ssize_t ret = read(event_fd, &count, sizeof(count));
+        (void) ret;
+        std::vector<Job> replies;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            replies.swap(done);
+        }
+        std::vector<long long> touched;
+        for(size_t i = 0; i < replies.size(); ++i) {
+            std::map<long long, Connection>::iterator it =
+                connections.find(replies[i].connection);
+            if(it == connections.end()) continue;
+            it->second.ready[replies[i].seq].swap(replies[i].text);
+            touched.push_back(replies[i].connection);
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for(size_t i = 0; i < touched.size(); ++i)
+            if(connections.count(touched[i])) flush_ready(touched[i]);
+    }
+
+    bool listen_unix(const std::string &path) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        if(path.size() >= sizeof(addr.sun_path)) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path.c_str());
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listen_fd == -1) return false;
+        unlink(path.c_str());
+        if(bind(listen_fd, (sockaddr *) &addr, sizeof(addr)) == -1) return false;
+        unix_path = path;
+        return true;
+    }
+
+    bool listen_tcp(const std::string &host, const int &port) {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if(inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            errno = EINVAL;
+            return false;
+        }
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(listen_fd == -1) return false;
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        return bind(listen_fd, (sockaddr *) &addr, sizeof(addr)) != -1;
+    }
+
+public :
+    QueryServer(
+            const Handler &request_handler,
+            const std::string &timeout_text,
+            const std::string &long_line_text,
+            const int &thread_count,
+            const int &deadline_ms
+            ) :
+        handler(request_handler), timeout_reply(timeout_text),
+        long_line_reply(long_line_text), deadline(deadline_ms) {
+        listen_fd = -1;
+        epoll_fd = epoll_create1(0);
+        event_fd = eventfd(0, EFD_NONBLOCK);
+        next_connection = 1;
+        stopping = false, quit = false;
+        num_worker = thread_count < 1 ? 1 : thread_count;
+        for(size_t i = 0; i < num_worker; ++i)
+            workers.push_back(std::thread(&QueryServer::work, this));
+    }
+
+    ~QueryServer() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+        while(!connections.empty())
+            close_connection(connections.begin()->first);
+        if(listen_fd != -1) close(listen_fd);
+        if(!unix_path.empty()) unlink(unix_path.c_str());
+        close(epoll_fd);
+        close(event_fd);
+    }
+
+    bool listen(const std::string &address) {
+        /**
+         * Address: "unix:PATH" for a Unix socket, "HOST:PORT" or "PORT"
+         * for TCP on IPv4, HOST being 127.0.0.1 if it is left out.
+         * Return false with errno set if the socket cannot be opened.
+         * */
+        bool ok;
+        if(address.compare(0, 5, "unix:") == 0)
+            ok = listen_unix(address.substr(5));
+        else {
+            size_t colon = address.rfind(':');
+            std::string host = colon == std::string::npos ?
+                "127.0.0.1" : address.substr(0, colon);
+            std::string port = colon == std::string::npos ?
+                address : address.substr(colon + 1);
+            if(port.empty() || port.find_first_not_of("0123456789") != std::string::npos) {
+                errno = EINVAL;
+                return false;
+            }
+            ok = listen_tcp(host, atoi(port.c_str()));
+        }
+        if(!ok || ::listen(listen_fd, SOMAXCONN) == -1 || !set_nonblocking(listen_fd))
+            return false;
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+        ev.data.u64 = -1;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+        return true;
+    }
+
+    void run() {
+        /**
+         * Serve until stop is called.
+         * */
+        const int MAX_EVENT = 256;
+        epoll_event events[MAX_EVENT];
+        while(!quit) {
+            int n = epoll_wait(epoll_fd, events, MAX_EVENT, -1);
+            if(n == -1 && errno != EINTR) return;
+            for(int i = 0; i < n; ++i) {
+                long long id = events[i].data.u64;
+                if(id == 0) accept_all();
+                else if(id == -1) collect_replies();
+                else if(connections.count(id)) {
+                    if(events[i].events & (EPOLLERR | EPOLLHUP) &&
+                            !(events[i].events & EPOLLIN)) {
+                        close_connection(id);
+                        continue;
+                    }
+                    if(events[i].events & EPOLLIN) read_requests(id);
+                    else flush_ready(id);
+                }
+            }
+        }
+    }
+
+    void stop() {
+        /**
+         * Make run return. Safe to call from a signal handler.
+         * */
+        quit = true;
+        uint64_t one = 1;
+        ssize_t ret = write(event_fd, &one, sizeof(one));
+        (void) ret;
+    }
+};
@@ -0,0 +1,22 @@
+#include "metro.cpp"
+
+int main(int argc, char **argv)
+{
+    /**
+     * Compile the data files listed in Metro::SUBWAY_NAME into a snapshot
+     * that Metro can map at startup instead of parsing the text.
+     * Usage: metro_snapshot [output file], "metro.snapshot" by default.
+     * */
+    const char *filename = argc > 1 ? argv[1] : "metro.snapshot";
+    Metro *metro = new Metro(Metro::SUBWAY_NAME, 10);
+    if (!metro->save_snapshot(filename)) {
+        printf("Unable to write %s\n", filename);
+        return 1;
+    }
+    Metro *check = new Metro(string(filename));
+    vector< pair<int, string> > stations = check->list_all_stations();
+    printf("%s: %zu stations\n", filename, stations.size());
+    delete check;
+    delete metro;
+    return stations.empty() ? 1 : 0;
+}
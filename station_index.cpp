@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#define STATION_MATCH_MAX_EDIT (2)
+/**
+ * Most typos StationIndex::match allows. Text of n code points allows
+ * n / 3 of them up to this, so that a short text is never matched to
+ * nearly anything.
+ * */
+
+int next_code_point(std::string_view text, size_t &i) {
+    /**
+     * Decode the UTF-8 code point at text[i] and move i past it. ASCII
+     * letters are folded to lower case. A byte that does not start a valid
+     * sequence is taken alone, as a value above every code point.
+     * */
+    unsigned char c = text[i++];
+    if(c < 0x80) return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    int length = c >= 0xf8 ? -1 : c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : -1;
+    if(length == -1 || i + length > text.size()) return 0x110000 + c;
+    int code = c & (0x3f >> length);
+    for(int k = 0; k < length; ++k) {
+        unsigned char d = text[i + k];
+        if((d & 0xc0) != 0x80) return 0x110000 + c;
+        code = code << 6 | (d & 0x3f);
+    }
+    i += length;
+    return code;
+}
+
+struct StationMatch {
+    /**
+     * A station found by StationIndex::match.
+     * Distance: Typos between the text and the start of its name, that
+     *           is code points inserted, removed or replaced.
+     * Exact: Whether its whole name is the text.
+     * */
+    int station, distance;
+    bool exact;
+};
+
+class StationIndex {
+    /**
+     * A trie of station names by code point, to find stations from a name
+     * as it is typed. Nodes are numbered in preorder with children in code
+     * point order, so the stations whose names pass through node v are
+     * station_order[node_begin[v]] to station_order[node_begin[node_end[v]] - 1],
+     * in name order, the node_here[v] names ending at v first.
+     * Child_begin, Child_code, Child_node: The children of node v are
+     *                                      child_node[k] for k in
+     *                                      [child_begin[v], child_begin[v + 1]),
+     *                                      reached by code point child_code[k].
+     * Name_rank: Position of each station in station_order.
+     * Max_depth: Code points of the longest name.
+     * Popularity: How busy each station is, higher first among matches
+     *             as close to the text.
+     * Range_best: A segment tree over station_order, range_best[n + i] = i
+     *             for n stations and every other node the position of the
+     *             more popular station of its two children, so that the
+     *             most popular names below a node are found without
+     *             looking at all of them.
+     * */
+private :
+    std::vector<int> child_begin, child_code, child_node;
+    std::vector<int> node_end, node_begin, node_here;
+    std::vector<int> station_order, name_rank, popularity, range_best;
+    int max_depth;
+
+    struct Span {
+        int begin, end, best;
+    };
+
+    struct Workspace {
+        std::vector<int> code, row;
+        std::vector<StationMatch> found;
+        std::vector<Span> heap;
+    };
+
+    typedef std::vector<std::pair<std::vector<int>, int> > KeyList;
+
+    int add_node(const KeyList &keys, int low, const int &high, const int &depth) {
+        /**
+         * Add the node of the names keys[low, high) share up to depth, and
+         * everything below it. Return the node.
+         * */
+        int v = node_end.size();
+        node_end.push_back(0);
+        node_begin.push_back(station_order.size());
+        node_here.push_back(0);
+        child_begin.push_back(child_code.size());
+        for( ; low < high && (int) keys[low].first.size() == depth; ++low) {
+            station_order.push_back(keys[low].second);
+            ++node_here[v];
+        }
+        std::vector<int> group;
+        for(int i = low; i < high; ++i)
+            if(i == low || keys[i].first[depth] != keys[i - 1].first[depth]) {
+                group.push_back(i);
+                child_code.push_back(keys[i].first[depth]);
+                child_node.push_back(-1);
+            }
+        group.push_back(high);
+        int first = child_code.size() - (group.size() - 1);
+        for(size_t g = 0; g + 1 < group.size(); ++g)
+            child_node[first + g] = add_node(keys, group[g], group[g + 1], depth + 1);
+        node_end[v] = node_end.size();
+        return v;
+    }
+
+    bool before(const int &i, const int &j) const {
+        /**
+         * Whether station_order[i] ranks before station_order[j] among
+         * matches as close to the text.
+         * */
+        int a = popularity[station_order[i]], b = popularity[station_order[j]];
+        return a != b ? a > b : i < j;
+    }
+
+    int best_in(int begin, int end) const {
+        /**
+         * Position of the best ranked station of station_order[begin, end),
+         * which is not empty.
+         * */
+        const int n = station_order.size();
+        int ret = begin;
+        for(begin += n, end += n; begin < end; begin /= 2, end /= 2) {
+            if(begin & 1) {
+                if(before(range_best[begin], ret)) ret = range_best[begin];
+                ++begin;
+            }
+            if(end & 1) {
+                --end;
+                if(before(range_best[end], ret)) ret = range_best[end];
+            }
+        }
+        return ret;
+    }
+
+    void add_found(const int &begin, const int &end, const int &distance,
+            const bool &exact, const int &limit, Workspace &workspace) const {
+        /**
+         * Add the stations of station_order[begin, end) at distance. Only
+         * the best limit of them can be answered, so a longer range only
+         * adds those.
+         * */
+        StationMatch match;
+        match.distance = distance;
+        match.exact = exact;
+        if(end - begin <= limit) {
+            for(int i = begin; i < end; ++i) {
+                match.station = station_order[i];
+                workspace.found.push_back(match);
+            }
+            return;
+        }
+        std::vector<Span> &heap = workspace.heap;
+        auto worse = [this](const Span &a, const Span &b) {
+            return before(b.best, a.best);
+        };
+        heap.clear();
+        Span span = {begin, end, best_in(begin, end)};
+        heap.push_back(span);
+        for(int k = 0; k < limit; ++k) {
+            std::pop_heap(heap.begin(), heap.end(), worse);
+            span = heap.back();
+            heap.pop_back();
+            match.station = station_order[span.best];
+            workspace.found.push_back(match);
+            Span left = {span.begin, span.best, 0}, right = {span.best + 1, span.end, 0};
+            if(left.begin < left.end) {
+                left.best = best_in(left.begin, left.end);
+                heap.push_back(left);
+                std::push_heap(heap.begin(), heap.end(), worse);
+            }
+            if(right.begin < right.end) {
+                right.best = best_in(right.begin, right.end);
+                heap.push_back(right);
+                std::push_heap(heap.begin(), heap.end(), worse);
+            }
+        }
+    }
+
+    void visit(const int &v, const int &depth, int best, const int &max_edit,
+            const int &limit, Workspace &workspace) const {
+        /**
+         * Collect the names through v within max_edit of the text, the
+         * edit distances from the text to the name up to v being the
+         * row of depth. Best is the fewest typos of the names of an
+         * ancestor of v to the text.
+         * */
+        const int m = workspace.code.size();
+        const int *row = &workspace.row[depth * (m + 1)];
+        int low = row[m];
+        for(int j = 0; j < m; ++j) low = std::min(low, row[j]);
+        best = std::min(best, row[m]);
+        if(best <= low) {
+            /**
+             * No name below v is closer to the text than best.
+             * */
+            if(best > max_edit) return;
+            add_found(node_begin[v], node_begin[v] + node_here[v], best, row[m] == 0,
+                    limit, workspace);
+            add_found(node_begin[v] + node_here[v], node_begin[node_end[v]], best, false,
+                    limit, workspace);
+            return;
+        }
+        if(low > max_edit) return;
+        if(best <= max_edit)
+            add_found(node_begin[v], node_begin[v] + node_here[v], best, false,
+                    limit, workspace);
+        int *next = &workspace.row[(depth + 1) * (m + 1)];
+        for(int k = child_begin[v]; k < child_begin[v + 1]; ++k) {
+            next[0] = row[0] + 1;
+            for(int j = 1; j <= m; ++j)
+                next[j] = std::min(std::min(row[j], next[j - 1]) + 1,
+                        row[j - 1] + (workspace.code[j - 1] != child_code[k]));
+            visit(child_node[k], depth + 1, best, max_edit, limit, workspace);
+        }
+    }
+
+public :
+    StationIndex() {
+        clear();
+    }
+
+    void clear() {
+        child_begin.clear(), child_code.clear(), child_node.clear();
+        node_end.clear(), node_begin.clear(), node_here.clear();
+        station_order.clear(), name_rank.clear(), popularity.clear();
+        range_best.clear();
+        max_depth = 0;
+    }
+
+    bool empty() const {
+        return node_end.empty();
+    }
+
+    size_t memory() const {
+        /**
+         * Bytes held by the arrays.
+         * */
+        return (child_begin.capacity() + child_code.capacity() + child_node.capacity() +
+                node_end.capacity() + node_begin.capacity() + node_here.capacity() +
+                station_order.capacity() + name_rank.capacity() +
+                popularity.capacity() + range_best.capacity()) * sizeof(int);
+    }
+
+    void build(const std::vector<std::string_view> &names,
+            const std::vector<int> &station_popularity) {
+        /**
+         * Index the name of every station u >= 1, names[u], with the
+         * popularity station_popularity[u].
+         * */
+        clear();
+        KeyList keys(names.empty() ? 0 : names.size() - 1);
+        for(size_t u = 1; u < names.size(); ++u) {
+            for(size_t i = 0; i < names[u].size(); )
+                keys[u - 1].first.push_back(next_code_point(names[u], i));
+            keys[u - 1].second = u;
+            max_depth = std::max(max_depth, (int) keys[u - 1].first.size());
+        }
+        std::sort(keys.begin(), keys.end());
+        add_node(keys, 0, keys.size(), 0);
+        child_begin.push_back(child_code.size());
+        node_begin.push_back(station_order.size());
+        name_rank.assign(names.size(), 0);
+        for(size_t i = 0; i < station_order.size(); ++i)
+            name_rank[station_order[i]] = i;
+        popularity = station_popularity;
+        popularity.resize(names.size(), 0);
+        const int n = station_order.size();
+        range_best.assign(2 * n, 0);
+        for(int i = 0; i < n; ++i)
+            range_best[n + i] = i;
+        for(int i = n - 1; i >= 1; --i) {
+            int a = range_best[2 * i], b = range_best[2 * i + 1];
+            range_best[i] = before(b, a) ? b : a;
+        }
+    }
+
+    int match(std::string_view text, const int &limit, std::vector<StationMatch> &ret) const {
+        /**
+         * Find up to limit stations whose name starts with text, allowing a
+         * few typos (see STATION_MATCH_MAX_EDIT), best first: the name equal
+         * to text, then fewer typos, then more popular stations, then name
+         * order. Return how many were found.
+         * */
+        ret.clear();
+        static thread_local Workspace workspace;
+        workspace.code.clear(), workspace.found.clear();
+        for(size_t i = 0; i < text.size(); )
+            workspace.code.push_back(next_code_point(text, i));
+        const int m = workspace.code.size();
+        if(m == 0 || limit <= 0 || empty()) return 0;
+        if((int) workspace.row.size() < (max_depth + 1) * (m + 1))
+            workspace.row.resize((max_depth + 1) * (m + 1));
+        for(int j = 0; j <= m; ++j) workspace.row[j] = j;
+        /**
+         * Matches with fewer typos rank first, so more typos are only
+         * allowed while fewer than limit stations are found.
+         * */
+        int max_edit = std::min(STATION_MATCH_MAX_EDIT, m / 3);
+        for(int edit = 0; edit <= max_edit; ++edit) {
+            workspace.found.clear();
+            visit(0, 0, m, edit, limit, workspace);
+            if((int) workspace.found.size() >= limit) break;
+        }
+
+        std::vector<StationMatch> &found = workspace.found;
+        size_t n = std::min(found.size(), (size_t) limit);
+        std::partial_sort(found.begin(), found.begin() + n, found.end(),
+                [this](const StationMatch &a, const StationMatch &b) {
+                    if(a.exact != b.exact) return a.exact;
+                    if(a.distance != b.distance) return a.distance < b.distance;
+                    if(popularity[a.station] != popularity[b.station])
+                        return popularity[a.station] > popularity[b.station];
+                    return name_rank[a.station] < name_rank[b.station];
+                });
+        ret.assign(found.begin(), found.begin() + n);
+        return n;
+    }
+};
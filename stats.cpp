@@ -0,0 +1,337 @@
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define STATS_BUCKET (32)
+/**
+ * Buckets of a Histogram: bucket b counts the values up to 2^b that no
+ * earlier bucket counts, the last one every larger value as well.
+ * */
+
+#define NUM_ANSWER_SOURCE (5)
+#define SOURCE_CACHE (0)
+#define SOURCE_TABLE (1)
+#define SOURCE_HIERARCHY (2)
+#define SOURCE_LANDMARK (3)
+#define SOURCE_SEARCH (4)
+
+const char *ANSWER_SOURCE_NAME[] = {
+    "cache",
+    "table",
+    "hierarchy",
+    "landmark",
+    "search"
+};
+
+struct SearchCounters {
+    /**
+     * Work done by the searches of one query, counted in its workspace.
+     * Settled: Nodes or labels taken from a queue and expanded.
+     * Relaxed: Arcs looked at from them.
+     * Pushed: Entries put on a queue.
+     * Repushed: Entries pushed for a node that was already queued.
+     * */
+    long long settled, relaxed, pushed, repushed;
+
+    SearchCounters() {
+        clear();
+    }
+
+    void clear() {
+        settled = relaxed = pushed = repushed = 0;
+    }
+};
+
+struct HistogramStats {
+    /**
+     * A Histogram as read at one moment.
+     * Bucket: Count of each bucket, see STATS_BUCKET.
+     * Count, Sum: Number and total of the values added.
+     * */
+    long long bucket[STATS_BUCKET], count, sum;
+};
+
+class Histogram {
+    /**
+     * Counts of values by powers of two, added to from several threads at
+     * once without locks.
+     * */
+private :
+    std::atomic<long long> bucket[STATS_BUCKET], count, sum;
+
+public :
+    Histogram() {
+        for(int b = 0; b < STATS_BUCKET; ++b)
+            bucket[b].store(0);
+        count.store(0), sum.store(0);
+    }
+
+    void add(const long long &value) {
+        int b = 0;
+        while(b < STATS_BUCKET - 1 && (1LL << b) < value) ++b;
+        bucket[b].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    HistogramStats read() const {
+        HistogramStats ret;
+        for(int b = 0; b < STATS_BUCKET; ++b)
+            ret.bucket[b] = bucket[b].load(std::memory_order_relaxed);
+        ret.count = count.load(std::memory_order_relaxed);
+        ret.sum = sum.load(std::memory_order_relaxed);
+        return ret;
+    }
+};
+
+struct CriterionStats {
+    /**
+     * Counters of the queries of one criterion since stats were enabled.
+     * Name: Name of the criterion.
+     * Query: Queries answered, out-of-range stations left out.
+     * Answered_by: Queries answered by each source of ANSWER_SOURCE_NAME.
+     * Work: Search work of all of them.
+     * Nanos: Wall time of each query in nanoseconds.
+     * Stations: Stations on each route found, unreachable ones left out.
+     * Slowest_start, Slowest_end, Slowest_nanos: The slowest query, all 0
+     *                                            before the first one.
+     * */
+    std::string name;
+    long long query, answered_by[NUM_ANSWER_SOURCE];
+    SearchCounters work;
+    HistogramStats nanos, stations;
+    int slowest_start, slowest_end;
+    long long slowest_nanos;
+};
+
+class QueryRecorder {
+    /**
+     * Counters of the queries of each criterion, recorded by several
+     * threads at once. Only a new slowest query takes a lock.
+     * */
+private :
+    struct Counters {
+        std::atomic<long long> query, answered_by[NUM_ANSWER_SOURCE];
+        std::atomic<long long> settled, relaxed, pushed, repushed;
+        Histogram nanos, stations;
+        std::mutex slowest_lock;
+        std::atomic<long long> slowest_nanos;
+        int slowest_start, slowest_end;
+
+        Counters() {
+            query.store(0);
+            for(int s = 0; s < NUM_ANSWER_SOURCE; ++s)
+                answered_by[s].store(0);
+            settled.store(0), relaxed.store(0), pushed.store(0), repushed.store(0);
+            slowest_nanos.store(0);
+            slowest_start = slowest_end = 0;
+        }
+    };
+
+    std::vector<Counters> counters;
+
+public :
+    QueryRecorder(const int &num_criterion) : counters(num_criterion) {}
+
+    void record(
+            const int &criterion,
+            const int &source,
+            const int &start,
+            const int &end,
+            const SearchCounters &work,
+            const int &num_station,
+            const long long &nanos
+            ) {
+        Counters &now = counters[criterion];
+        now.query.fetch_add(1, std::memory_order_relaxed);
+        now.answered_by[source].fetch_add(1, std::memory_order_relaxed);
+        now.settled.fetch_add(work.settled, std::memory_order_relaxed);
+        now.relaxed.fetch_add(work.relaxed, std::memory_order_relaxed);
+        now.pushed.fetch_add(work.pushed, std::memory_order_relaxed);
+        now.repushed.fetch_add(work.repushed, std::memory_order_relaxed);
+        now.nanos.add(nanos);
+        if(num_station > 0) now.stations.add(num_station);
+        if(nanos <= now.slowest_nanos.load(std::memory_order_relaxed)) return;
+        std::lock_guard<std::mutex> guard(now.slowest_lock);
+        if(nanos <= now.slowest_nanos.load(std::memory_order_relaxed)) return;
+        now.slowest_nanos.store(nanos, std::memory_order_relaxed);
+        now.slowest_start = start, now.slowest_end = end;
+    }
+
+    CriterionStats read(const int &criterion) {
+        Counters &now = counters[criterion];
+        CriterionStats ret;
+        ret.query = now.query.load(std::memory_order_relaxed);
+        for(int s = 0; s < NUM_ANSWER_SOURCE; ++s)
+            ret.answered_by[s] = now.answered_by[s].load(std::memory_order_relaxed);
+        ret.work.settled = now.settled.load(std::memory_order_relaxed);
+        ret.work.relaxed = now.relaxed.load(std::memory_order_relaxed);
+        ret.work.pushed = now.pushed.load(std::memory_order_relaxed);
+        ret.work.repushed = now.repushed.load(std::memory_order_relaxed);
+        ret.nanos = now.nanos.read();
+        ret.stations = now.stations.read();
+        std::lock_guard<std::mutex> guard(now.slowest_lock);
+        ret.slowest_nanos = now.slowest_nanos.load(std::memory_order_relaxed);
+        ret.slowest_start = now.slowest_start, ret.slowest_end = now.slowest_end;
+        return ret;
+    }
+};
+
+struct MemoryStats {
+    /**
+     * Bytes held by each part of a Metro.
+     * Graph: The station and line-expanded graphs, and the disruption
+     *        state; the mapped file when loaded from a snapshot.
+     * Names: The name pool and the tables indexing it.
+     * Timetable, Tables, Landmarks, Hierarchy: The indexes of
+     *                                          query_departure,
+     *                                          precompute_routes,
+     *                                          precompute_landmarks and
+     *                                          the contraction
+     *                                          hierarchies.
+     * Cache: The query cache, estimated from its entries.
+     * */
+    long long graph, names, timetable, tables, landmarks, hierarchy, cache;
+
+    MemoryStats() {
+        graph = names = timetable = tables = landmarks = hierarchy = cache = 0;
+    }
+
+    long long total() const {
+        return graph + names + timetable + tables + landmarks + hierarchy + cache;
+    }
+};
+
+struct MetroStats {
+    /**
+     * Everything Metro::stats reports.
+     * Enabled: Whether queries are being recorded, see Metro::enable_stats;
+     *          criterion is empty if not.
+     * */
+    bool enabled;
+    std::vector<CriterionStats> criterion;
+    MemoryStats memory;
+    CacheStats cache;
+};
+
+void append_histogram(
+        std::string &out,
+        const char *name,
+        const std::string &labels,
+        const HistogramStats &histogram,
+        const int &first,
+        const int &last,
+        const double &scale
+        ) {
+    /**
+     * Append the lines of one Prometheus histogram, with its values and
+     * bounds multiplied by scale. Only the bounds of buckets [first, last)
+     * are written, the buckets out of them count towards the nearest one
+     * written or towards +Inf.
+     * */
+    char line[256];
+    long long total = 0;
+    for(int b = 0; b < STATS_BUCKET; ++b) {
+        total += histogram.bucket[b];
+        if(b < first || b >= last) continue;
+        snprintf(line, sizeof(line), "%s_bucket{%s,le=\"%.9g\"} %lld\n",
+                name, labels.c_str(), (double) (1LL << b) * scale, total);
+        out += line;
+    }
+    snprintf(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %lld\n",
+            name, labels.c_str(), total);
+    out += line;
+    snprintf(line, sizeof(line), "%s_sum{%s} %.9g\n%s_count{%s} %lld\n",
+            name, labels.c_str(), (double) histogram.sum * scale,
+            name, labels.c_str(), histogram.count);
+    out += line;
+}
+
+std::string format_prometheus(const MetroStats &stats) {
+    /**
+     * Stats in the Prometheus text exposition format.
+     * */
+    std::string out;
+    char line[256];
+    const MemoryStats &memory = stats.memory;
+    const char *part[] = {
+        "graph", "names", "timetable", "tables", "landmarks", "hierarchy", "cache"
+    };
+    long long bytes[] = {
+        memory.graph, memory.names, memory.timetable, memory.tables,
+        memory.landmarks, memory.hierarchy, memory.cache
+    };
+    out += "# HELP metro_memory_bytes Bytes held by each part of the network.\n";
+    out += "# TYPE metro_memory_bytes gauge\n";
+    for(int i = 0; i < 7; ++i) {
+        snprintf(line, sizeof(line), "metro_memory_bytes{part=\"%s\"} %lld\n",
+                part[i], bytes[i]);
+        out += line;
+    }
+
+    out += "# HELP metro_cache_lookups_total Lookups of the query cache.\n";
+    out += "# TYPE metro_cache_lookups_total counter\n";
+    snprintf(line, sizeof(line),
+            "metro_cache_lookups_total{result=\"hit\"} %lld\n"
+            "metro_cache_lookups_total{result=\"miss\"} %lld\n",
+            stats.cache.hit, stats.cache.miss);
+    out += line;
+    out += "# TYPE metro_cache_evictions_total counter\n";
+    snprintf(line, sizeof(line), "metro_cache_evictions_total %lld\n", stats.cache.eviction);
+    out += line;
+    out += "# TYPE metro_cache_entries gauge\n";
+    snprintf(line, sizeof(line), "metro_cache_entries %lld\n", stats.cache.size);
+    out += line;
+    if(!stats.enabled) return out;
+
+    const char *work_name[] = {"settled", "relaxed", "pushed", "repushed"};
+    out += "# HELP metro_queries_total Queries answered, by the source of the answer.\n";
+    out += "# TYPE metro_queries_total counter\n";
+    for(size_t c = 0; c < stats.criterion.size(); ++c)
+        for(int s = 0; s < NUM_ANSWER_SOURCE; ++s) {
+            snprintf(line, sizeof(line),
+                    "metro_queries_total{criterion=\"%s\",source=\"%s\"} %lld\n",
+                    stats.criterion[c].name.c_str(), ANSWER_SOURCE_NAME[s],
+                    stats.criterion[c].answered_by[s]);
+            out += line;
+        }
+    for(int w = 0; w < 4; ++w) {
+        snprintf(line, sizeof(line),
+                "# HELP metro_search_%s_total Search work: %s.\n"
+                "# TYPE metro_search_%s_total counter\n",
+                work_name[w], work_name[w], work_name[w]);
+        out += line;
+        for(size_t c = 0; c < stats.criterion.size(); ++c) {
+            const SearchCounters &work = stats.criterion[c].work;
+            long long value[] = {work.settled, work.relaxed, work.pushed, work.repushed};
+            snprintf(line, sizeof(line), "metro_search_%s_total{criterion=\"%s\"} %lld\n",
+                    work_name[w], stats.criterion[c].name.c_str(), value[w]);
+            out += line;
+        }
+    }
+    out += "# HELP metro_query_duration_seconds Wall time of each query.\n";
+    out += "# TYPE metro_query_duration_seconds histogram\n";
+    for(size_t c = 0; c < stats.criterion.size(); ++c)
+        append_histogram(out, "metro_query_duration_seconds",
+                "criterion=\"" + stats.criterion[c].name + "\"",
+                stats.criterion[c].nanos, 7, STATS_BUCKET - 1, 1e-9);
+    out += "# HELP metro_route_stations Stations on each route found.\n";
+    out += "# TYPE metro_route_stations histogram\n";
+    for(size_t c = 0; c < stats.criterion.size(); ++c)
+        append_histogram(out, "metro_route_stations",
+                "criterion=\"" + stats.criterion[c].name + "\"",
+                stats.criterion[c].stations, 0, 18, 1);
+    out += "# HELP metro_slowest_query_seconds The slowest query and its stations.\n";
+    out += "# TYPE metro_slowest_query_seconds gauge\n";
+    for(size_t c = 0; c < stats.criterion.size(); ++c) {
+        const CriterionStats &now = stats.criterion[c];
+        snprintf(line, sizeof(line),
+                "metro_slowest_query_seconds{criterion=\"%s\",start=\"%d\",end=\"%d\"} %.9g\n",
+                now.name.c_str(), now.slowest_start, now.slowest_end,
+                now.slowest_nanos * 1e-9);
+        out += line;
+    }
+    return out;
+}
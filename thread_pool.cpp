@@ -0,0 +1,144 @@
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    /**
+     * A fixed set of worker threads running numbered tasks.
+     * Each worker owns a queue of task numbers. It takes work from the front
+     * of its own queue and, once that is empty, steals from the back of the
+     * others, so slow tasks on one worker do not leave the rest idle.
+     * Runs from different threads take turns, since they share the workers.
+     * */
+private :
+    struct TaskQueue {
+        std::mutex lock;
+        std::deque<int> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<TaskQueue> queues;
+    std::mutex lock, run_lock;
+    std::condition_variable wake, finished;
+    const std::function<void(int, int)> *job;
+    long long generation;
+    int remaining;
+    bool stopping;
+
+    /**
+     * The pool and worker index of the calling thread, if it is a worker,
+     * so that run can tell a task calling it again.
+     * */
+    static thread_local const ThreadPool *running_pool;
+    static thread_local int running_worker;
+
+    bool take_task(const int &worker, int &task) {
+        /**
+         * Get a task for worker, from its own queue first.
+         * Return false if every queue is empty.
+         * */
+        int num_worker = queues.size();
+        for(int i = 0; i < num_worker; ++i) {
+            TaskQueue &queue = queues[(worker + i) % num_worker];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if(queue.tasks.empty()) continue;
+            if(i == 0) {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            } else {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void work(const int worker) {
+        running_pool = this, running_worker = worker;
+        long long seen = 0;
+        while(true) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                while(!stopping && generation == seen)
+                    wake.wait(guard);
+                if(stopping) return;
+                seen = generation;
+            }
+            int task;
+            while(take_task(worker, task)) {
+                const std::function<void(int, int)> *now;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    now = job;
+                }
+                (*now)(task, worker);
+                std::lock_guard<std::mutex> guard(lock);
+                if(--remaining == 0) finished.notify_all();
+            }
+        }
+    }
+
+public :
+    ThreadPool(const int &num_thread) :
+        queues(num_thread < 1 ? 1 : num_thread) {
+        job = NULL;
+        generation = 0, remaining = 0, stopping = false;
+        for(int i = 0; i < (int) queues.size(); ++i)
+            workers.push_back(std::thread(&ThreadPool::work, this, i));
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    int size() const {
+        return workers.size();
+    }
+
+    void run(const int &num_task, const std::function<void(int, int)> &task_job) {
+        /**
+         * Call task_job(task, worker) for every task in [0, num_task) and
+         * wait until all of them are done. Worker is the index of the thread
+         * running the task, in [0, size()).
+         * Tasks start out split into contiguous blocks, one per worker.
+         * A task calling run on its own pool would wait for itself, so
+         * those tasks run one after another on its thread instead, as the
+         * worker it is.
+         * */
+        if(num_task <= 0) return;
+        if(running_pool == this) {
+            for(int t = 0; t < num_task; ++t)
+                task_job(t, running_worker);
+            return;
+        }
+        std::lock_guard<std::mutex> serial(run_lock);
+        std::unique_lock<std::mutex> guard(lock);
+        job = &task_job;
+        remaining = num_task;
+        int num_worker = queues.size();
+        for(int i = 0; i < num_worker; ++i) {
+            std::lock_guard<std::mutex> queue_guard(queues[i].lock);
+            for(int t = (long long) num_task * i / num_worker;
+                    t < (long long) num_task * (i + 1) / num_worker; ++t)
+                queues[i].tasks.push_back(t);
+        }
+        ++generation;
+        wake.notify_all();
+        while(remaining > 0)
+            finished.wait(guard);
+        job = NULL;
+    }
+};
+
+thread_local const ThreadPool *ThreadPool::running_pool = NULL;
+thread_local int ThreadPool::running_worker = -1;
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int parse_clock(const std::string &text) {
+    /**
+     * Minutes after midnight of "HH:MM", -1 if text is not such a time.
+     * Hours up to 47 are accepted for service running past midnight.
+     * */
+    int hour, minute;
+    char rest;
+    if(sscanf(text.c_str(), "%d:%d%c", &hour, &minute, &rest) != 2) return -1;
+    if(hour < 0 || hour >= 48 || minute < 0 || minute >= 60) return -1;
+    return hour * 60 + minute;
+}
+
+struct TimetableEntry {
+    /**
+     * One line of a timetable file.
+     * First, Last, Headway: Trips leave every headway minutes from first
+     *                       up to last, both in minutes after midnight.
+     *                       A single trip has first == last.
+     * From: Name of the terminal the trips leave from, empty for both.
+     * */
+    int first, last, headway;
+    std::string from;
+};
+
+bool read_timetable(const std::string &filename, std::vector<TimetableEntry> &entries) {
+    /**
+     * Read a timetable file of a line. Every line of it is one of
+     *     headway FIRST LAST MINUTES [FROM]
+     *     trip TIME [FROM]
+     * with times as HH:MM. Empty lines and lines starting with '#' are
+     * skipped. Return false if the file cannot be opened.
+     * */
+    entries.clear();
+    std::ifstream in(filename.c_str());
+    if(!in) return false;
+    std::string line_data;
+    for(int number = 1; getline(in, line_data); ++number) {
+        if(line_data.empty() || line_data[0] == '#') continue;
+        char kind[16], first[16], last[16], from[256];
+        int headway = 0;
+        TimetableEntry entry;
+        from[0] = '\0';
+        if(sscanf(line_data.c_str(), "%15s", kind) != 1) continue;
+        bool ok;
+        if(std::string(kind) == "headway") {
+            ok = sscanf(line_data.c_str(), "%*s %15s %15s %d %255s",
+                    first, last, &headway, from) >= 3;
+            entry.first = parse_clock(first), entry.last = parse_clock(last);
+            entry.headway = headway;
+        } else if(std::string(kind) == "trip") {
+            ok = sscanf(line_data.c_str(), "%*s %15s %255s", first, from) >= 1;
+            entry.first = entry.last = parse_clock(first);
+            entry.headway = 1;
+        } else ok = false;
+        ok = ok && entry.first != -1 && entry.last >= entry.first && entry.headway > 0;
+        if(!ok) {
+            std::cout << filename << " line " << number << " is not valid." << std::endl;
+            continue;
+        }
+        entry.from = from;
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+struct Timetable {
+    /**
+     * Every line as two routes, one per direction, for timetable queries.
+     * Stops of route r are [route_stop_begin[r], route_stop_begin[r + 1])
+     * in riding order.
+     * Route_subway: Line of each route.
+     * Route_stop, Route_offset: Station of each stop, and minutes from the
+     *                           first stop to it.
+     * Route_arc: Arc of the line-expanded graph riding into each stop, -1
+     *            at the first stop.
+     * Route_trip: Departures from the first stop in minutes after midnight,
+     *             sorted; the trips of route r are
+     *             [route_trip_begin[r], route_trip_begin[r + 1]).
+     * Route_continuous: Whether the route has no timetable, so a train
+     *                   can be boarded at any time.
+     * Routes serving station u are [station_route_begin[u],
+     * station_route_begin[u + 1]) of station_route, with the stop of u on
+     * each route in station_route_stop.
+     * */
+    std::vector<int> route_subway, route_stop_begin, route_stop, route_offset;
+    std::vector<int> route_arc;
+    std::vector<int> route_trip_begin, route_trip;
+    std::vector<char> route_continuous;
+    std::vector<int> station_route_begin, station_route, station_route_stop;
+
+    void clear() {
+        route_subway.clear(), route_stop_begin.assign(1, 0);
+        route_stop.clear(), route_offset.clear();
+        route_arc.clear();
+        route_trip_begin.assign(1, 0), route_trip.clear();
+        route_continuous.clear();
+        station_route_begin.clear(), station_route.clear();
+        station_route_stop.clear();
+    }
+
+    int size() const {
+        return route_subway.size();
+    }
+
+    size_t memory() const {
+        /**
+         * Bytes held by the arrays.
+         * */
+        return (route_subway.capacity() + route_stop_begin.capacity() +
+                route_stop.capacity() + route_offset.capacity() +
+                route_arc.capacity() +
+                route_trip_begin.capacity() + route_trip.capacity() +
+                station_route_begin.capacity() + station_route.capacity() +
+                station_route_stop.capacity()) * sizeof(int) +
+            route_continuous.capacity();
+    }
+
+    void add_route(
+            const int &subway,
+            const std::vector<int> &stops,
+            const std::vector<int> &offsets,
+            const std::vector<int> &arcs,
+            std::vector<int> &trips,
+            const bool &continuous
+            ) {
+        route_subway.push_back(subway);
+        route_stop.insert(route_stop.end(), stops.begin(), stops.end());
+        route_offset.insert(route_offset.end(), offsets.begin(), offsets.end());
+        route_arc.insert(route_arc.end(), arcs.begin(), arcs.end());
+        route_stop_begin.push_back(route_stop.size());
+        std::sort(trips.begin(), trips.end());
+        trips.erase(std::unique(trips.begin(), trips.end()), trips.end());
+        route_trip.insert(route_trip.end(), trips.begin(), trips.end());
+        route_trip_begin.push_back(route_trip.size());
+        route_continuous.push_back(continuous);
+    }
+
+    void index_stations(const int &num_station) {
+        /**
+         * Fill the routes of each station, once every route is added.
+         * */
+        station_route_begin.assign(num_station + 2, 0);
+        for(size_t i = 0; i < route_stop.size(); ++i)
+            ++station_route_begin[route_stop[i] + 1];
+        for(int u = 1; u <= num_station + 1; ++u)
+            station_route_begin[u] += station_route_begin[u - 1];
+        std::vector<int> next(station_route_begin.begin(), station_route_begin.end() - 1);
+        station_route.assign(route_stop.size(), 0);
+        station_route_stop.assign(route_stop.size(), 0);
+        for(int r = 0; r < size(); ++r)
+            for(int i = route_stop_begin[r]; i < route_stop_begin[r + 1]; ++i) {
+                int k = next[route_stop[i]]++;
+                station_route[k] = r, station_route_stop[k] = i;
+            }
+    }
+
+    bool next_trip(
+            const int &route,
+            const int &stop,
+            const int &ready,
+            const std::vector<int> &delay,
+            int &departure
+            ) const {
+        /**
+         * Find the earliest trip of route that can be boarded at stop (an
+         * index into route_stop) at minute ready, and set departure to its
+         * departure from the first stop. Delay holds the minutes trains
+         * reach each stop late, because of slowed sections before it.
+         * Return false if there is none.
+         * */
+        int want = ready - route_offset[stop] - delay[stop];
+        if(route_continuous[route]) {
+            departure = want;
+            return true;
+        }
+        std::vector<int>::const_iterator end =
+            route_trip.begin() + route_trip_begin[route + 1];
+        std::vector<int>::const_iterator it = std::lower_bound(
+                route_trip.begin() + route_trip_begin[route], end, want);
+        if(it == end) return false;
+        departure = *it;
+        return true;
+    }
+
+    int arrival(const int &stop, const int &departure, const std::vector<int> &delay) const {
+        /**
+         * Minute the trip leaving the first stop at departure reaches stop,
+         * delay late as in next_trip.
+         * */
+        return departure + route_offset[stop] + delay[stop];
+    }
+};